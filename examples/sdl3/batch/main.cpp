@@ -0,0 +1,95 @@
+#include <SDL3/SDL.h>
+#include <SDL3/SDL_main.h>
+
+#include "SGL/SmallGraphicsLayer.hpp"
+#include "SGL/AssetManager.hpp"
+
+namespace sgl = SmallGraphicsLayer;
+using namespace sgl::Math;
+
+constexpr int screenWidth = 800;
+constexpr int screenHeight = 600;
+
+int main() {
+    if (!SDL_Init(SDL_INIT_VIDEO)) {
+        return 1;
+    }
+    
+    // Ensure an OpenGL context has been created.
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 4);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 1);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+
+    SDL_Window* window = SDL_CreateWindow("batched sprites (SDL3 window)", screenWidth, screenHeight, SDL_WINDOW_OPENGL);
+    SDL_GLContext ctx = SDL_GL_CreateContext(window);
+    bool open = true;
+
+    SDL_GL_SetSwapInterval(1);
+
+    sgl::EnableLogger();
+
+    sgl::Device device;
+    device.Init(screenWidth, screenHeight);
+
+    std::string sheet_path = "examples/sdl3/instance/resources/spritesheet.png";
+    std::string freaker_path = "examples/sdl3/sprite/freaker.png";
+
+    sgl::AssetManager::Request(sheet_path, sgl::AssetType::Texture);
+    sgl::AssetManager::Request(freaker_path, sgl::AssetType::Texture);
+
+    // A batch owns the textures it draws from, AddTexture() returns the slot to draw with.
+    // Construct with sgl::BatchMode::Sorted to gather sprites until End() and draw them sorted by
+    // (layer, texture), which keeps interleaved textures down to one flush per texture per layer.
+    sgl::BatchedSprite batch;
+    auto sheet = batch.AddTexture(sgl::AssetManager::GetTexture(sheet_path)->GetData());
+    auto freaker = batch.AddTexture(sgl::AssetManager::GetTexture(freaker_path)->GetData());
+
+    SDL_Event event;
+
+    while (open) {
+        while (SDL_PollEvent(&event)) {
+            switch (event.type) {
+                case SDL_EVENT_QUIT:
+                    open = false;
+                    break;
+
+                case SDL_EVENT_KEY_DOWN:
+                    if (event.key.key == SDLK_ESCAPE) {
+                        open = false;
+                    }
+                    break;
+
+                default:
+                    break;
+            }
+        }
+
+        device.Clear();  // default clear colour
+
+        batch.Begin();
+        // Every sprite between Begin() and End() that shares a texture goes into the same draw call.
+        // Switching texture (or filling the batch) flushes, so group draws by texture where you can.
+        for (int y = 0; y < screenHeight; y += 32) {
+            for (int x = 0; x < screenWidth; x += 32) {
+                // The region is a pixel rect {x, y, w, h} inside the texture
+                batch.Draw(sheet, {7 * 32, 3 * 32, 32, 32}, {static_cast<float>(x), static_cast<float>(y)});
+            }
+        }
+        Vec2 size = batch.TextureSize(freaker);
+        batch.Draw(freaker, {400, 300}, {size.x / 2, size.y / 2}, {1, 1}, sgl::Colours::Orange);
+        batch.End();
+
+        device.Refresh();
+
+        SDL_GL_SwapWindow(window);
+    }
+
+    batch.Destroy();
+    device.Shutdown();
+
+    SDL_DestroyWindow(window);
+    SDL_GL_DestroyContext(ctx);
+    SDL_Quit();
+
+    return 0;
+}
@@ -53,7 +53,8 @@ int main() {
     // Generate the instances to be drawn. 
     // Instanced rendering is great for large maps or repeating quantities of something that share an image.
     // Always prefer GPU instancing for drawing many entities as it cuts down numerous draw calls to one
-    // Later, SGL may be able to do CPU side sprite batching.
+    // For many different sprites that share a texture, see BatchedSprite (examples/sdl3/batch).
+    // For large static maps, see TileMap (examples/sdl3/tilemap).
     constexpr Vec2 map_start = {0, 0};
     for (int y = map_start.y; y < mapHeight; y++) {
         for (int x = map_start.x; x < mapWidth; x++) {
@@ -2,6 +2,23 @@
 
 #include <cmath>
 #include <algorithm>
+#include <span>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Mat4 products use SSE on x86 and NEON on ARM, define SGL_MATH_SCALAR to force the scalar loops.
+// Both do the same multiplies and adds in the same order, so results agree to within rounding. They match
+// bit for bit when the compiler doesn't contract the scalar multiply-adds into FMA (-ffp-contract=off).
+#if !defined(SGL_MATH_SCALAR)
+    #if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+        #define SGL_MATH_SSE 1
+        #include <xmmintrin.h>
+    #elif defined(__ARM_NEON) || defined(_M_ARM64)
+        #define SGL_MATH_NEON 1
+        #include <arm_neon.h>
+    #endif
+#endif
 
 namespace SmallGraphicsLayer::Math {
 
@@ -202,6 +219,16 @@ struct Mat4 {
 
     constexpr Mat4 operator*(const Mat4& r) const {
         Mat4 res;
+#if defined(SGL_MATH_SSE) || defined(SGL_MATH_NEON)
+        if (!std::is_constant_evaluated()) {
+            // each result column is this matrix's columns weighted by a column of r
+            for (int col = 0; col < 4; col++) {
+                const float* rc = &r.m[col * 4];
+                simd_store(&res.m[col * 4], simd_combine(rc[0], rc[1], rc[2], rc[3]));
+            }
+            return res;
+        }
+#endif
         for (int col = 0; col < 4; col++) {
             for (int row = 0; row < 4; row++) {
                 float sum = 0.f;
@@ -219,10 +246,20 @@ struct Mat4 {
     }
 
     constexpr Vec3 multiplyPoint(const Vec3& v) const {
-        float x = v.x * (*this)(0, 0) + v.y * (*this)(0, 1) + v.z * (*this)(0, 2) + (*this)(0, 3);
-        float y = v.x * (*this)(1, 0) + v.y * (*this)(1, 1) + v.z * (*this)(1, 2) + (*this)(1, 3);
-        float z = v.x * (*this)(2, 0) + v.y * (*this)(2, 1) + v.z * (*this)(2, 2) + (*this)(2, 3);
-        float w = v.x * (*this)(3, 0) + v.y * (*this)(3, 1) + v.z * (*this)(3, 2) + (*this)(3, 3);
+        float x, y, z, w;
+#if defined(SGL_MATH_SSE) || defined(SGL_MATH_NEON)
+        if (!std::is_constant_evaluated()) {
+            alignas(16) float out[4];
+            simd_store(out, simd_combine(v.x, v.y, v.z, 1.f));
+            x = out[0]; y = out[1]; z = out[2]; w = out[3];
+        } else
+#endif
+        {
+            x = v.x * (*this)(0, 0) + v.y * (*this)(0, 1) + v.z * (*this)(0, 2) + (*this)(0, 3);
+            y = v.x * (*this)(1, 0) + v.y * (*this)(1, 1) + v.z * (*this)(1, 2) + (*this)(1, 3);
+            z = v.x * (*this)(2, 0) + v.y * (*this)(2, 1) + v.z * (*this)(2, 2) + (*this)(2, 3);
+            w = v.x * (*this)(3, 0) + v.y * (*this)(3, 1) + v.z * (*this)(3, 2) + (*this)(3, 3);
+        }
         if (std::fabs(w) > 1e-6f) {
             float invW = 1.f / w;
             return {x * invW, y * invW, z * invW};
@@ -232,6 +269,13 @@ struct Mat4 {
 
     constexpr Vec3 multiplyVector(const Vec3& v) const {
         // no translation
+#if defined(SGL_MATH_SSE) || defined(SGL_MATH_NEON)
+        if (!std::is_constant_evaluated()) {
+            alignas(16) float out[4];
+            simd_store(out, simd_combine(v.x, v.y, v.z, 0.f));
+            return {out[0], out[1], out[2]};
+        }
+#endif
         return {
             v.x * (*this)(0, 0) + v.y * (*this)(0, 1) + v.z * (*this)(0, 2),
             v.x * (*this)(1, 0) + v.y * (*this)(1, 1) + v.z * (*this)(1, 2),
@@ -310,5 +354,195 @@ struct Mat4 {
         float hh = height * 0.5f;
         return ortho(-hw, hw, -hh, hh, zNear, zFar, depthZeroToOne);
     }
+
+private:
+#if defined(SGL_MATH_SSE)
+    using simd_t = __m128;
+    static void simd_store(float* out, simd_t v) { _mm_storeu_ps(out, v); }
+    // col0 * x + col1 * y + col2 * z + col3 * w, accumulated left to right like the scalar loops.
+    // Unaligned loads, the generated uniform structs pack Mat4 to 1 byte alignment.
+    simd_t simd_combine(float x, float y, float z, float w) const {
+        simd_t acc = _mm_mul_ps(_mm_loadu_ps(&m[0]), _mm_set1_ps(x));
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(&m[4]),  _mm_set1_ps(y)));
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(&m[8]),  _mm_set1_ps(z)));
+        return _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(&m[12]), _mm_set1_ps(w)));
+    }
+#elif defined(SGL_MATH_NEON)
+    using simd_t = float32x4_t;
+    static void simd_store(float* out, simd_t v) { vst1q_f32(out, v); }
+    // vmulq/vaddq rather than vfmaq, fused results would drift from the scalar path
+    simd_t simd_combine(float x, float y, float z, float w) const {
+        simd_t acc = vmulq_n_f32(vld1q_f32(&m[0]), x);
+        acc = vaddq_f32(acc, vmulq_n_f32(vld1q_f32(&m[4]),  y));
+        acc = vaddq_f32(acc, vmulq_n_f32(vld1q_f32(&m[8]),  z));
+        return vaddq_f32(acc, vmulq_n_f32(vld1q_f32(&m[12]), w));
+    }
+#endif
 };
+
+// 2D affine transform, the x/y part of a Mat4 without the z row and column.
+//   x' = a * x + c * y + tx
+//   y' = b * x + d * y + ty
+// Composing two is 12 multiplies against Mat4's 64, and toMat4() widens the result for a uniform.
+struct Affine2D {
+    float a{1}, b{0}, c{0}, d{1}, tx{0}, ty{0};
+
+    constexpr Affine2D() = default;
+    constexpr Affine2D(float a_, float b_, float c_, float d_, float tx_, float ty_)
+        : a(a_), b(b_), c(c_), d(d_), tx(tx_), ty(ty_) {}
+
+    static constexpr Affine2D identity() { return {}; }
+
+    // this applied after r, same order as Mat4
+    constexpr Affine2D operator*(const Affine2D& r) const noexcept {
+        return {
+            a * r.a + c * r.b,
+            b * r.a + d * r.b,
+            a * r.c + c * r.d,
+            b * r.c + d * r.d,
+            a * r.tx + c * r.ty + tx,
+            b * r.tx + d * r.ty + ty
+        };
+    }
+    constexpr Affine2D& operator*=(const Affine2D& r) noexcept { *this = *this * r; return *this; }
+
+    constexpr Vec2 multiplyPoint(const Vec2& v) const noexcept { return {a * v.x + c * v.y + tx, b * v.x + d * v.y + ty}; }
+    constexpr Vec2 multiplyVector(const Vec2& v) const noexcept { return {a * v.x + c * v.y, b * v.x + d * v.y}; }
+
+    constexpr float determinant() const noexcept { return a * d - b * c; }
+    // undefined when determinant() is 0
+    constexpr Affine2D inverse() const noexcept {
+        const float inv = 1.f / determinant();
+        const float ia = d * inv, ib = -b * inv, ic = -c * inv, id = a * inv;
+        return {ia, ib, ic, id, -(ia * tx + ic * ty), -(ib * tx + id * ty)};
+    }
+
+    // z passes through unchanged
+    constexpr Mat4 toMat4() const noexcept {
+        Mat4 m = Mat4::identity();
+        m(0, 0) = a;  m(0, 1) = c;  m(0, 3) = tx;
+        m(1, 0) = b;  m(1, 1) = d;  m(1, 3) = ty;
+        return m;
+    }
+
+    // factory functions
+    static constexpr Affine2D translate(const Vec2& t) { return {1, 0, 0, 1, t.x, t.y}; }
+    static constexpr Affine2D scale(const Vec2& s) { return {s.x, 0, 0, s.y, 0, 0}; }
+    // scale then translate in one step, the usual sprite model transform
+    static constexpr Affine2D translateScale(const Vec2& t, const Vec2& s) { return {s.x, 0, 0, s.y, t.x, t.y}; }
+
+    static Affine2D rotate(float radians) {
+        float c = std::cos(radians), s = std::sin(radians);
+        return {c, s, -s, c, 0, 0};
+    }
+
+    // x/y part of m, exact for matrices built from 2D translate/scale/rotateZ/ortho
+    static constexpr Affine2D fromMat4(const Mat4& m) { return {m(0, 0), m(1, 0), m(0, 1), m(1, 1), m(0, 3), m(1, 3)}; }
+
+    // x/y part of Mat4::ortho
+    static constexpr Affine2D ortho(float left, float right, float bottom, float top) {
+        const float rl = right - left;
+        const float tb = top - bottom;
+        return {2.f / rl, 0, 0, 2.f / tb, -(right + left) / rl, -(top + bottom) / tb};
+    }
+};
+
+// Runs fn(begin, end) over [0, count) split into `threads` contiguous ranges, the calling thread takes the first.
+// Ranges shorter than minPerThread are merged, so small counts never spawn threads.
+template <typename Fn>
+void ParallelFor(std::size_t count, unsigned threads, std::size_t minPerThread, Fn&& fn) {
+    const std::size_t most = minPerThread ? std::max<std::size_t>(count / minPerThread, 1) : count;
+    const std::size_t parts = std::clamp<std::size_t>(threads, 1, std::max<std::size_t>(most, 1));
+    if (parts <= 1) {
+        fn(std::size_t{0}, count);
+        return;
+    }
+    const std::size_t step = (count + parts - 1) / parts;
+    std::vector<std::thread> workers;
+    workers.reserve(parts - 1);
+    for (std::size_t begin = step; begin < count; begin += step) {
+        workers.emplace_back([&fn, begin, end = std::min(begin + step, count)] { fn(begin, end); });
+    }
+    fn(std::size_t{0}, std::min(step, count));
+    for (auto& w : workers) w.join();
+}
+
+// Batch point transforms, no perspective divide. out may alias in, sizes must match.
+// Same arithmetic and order as Affine2D::multiplyPoint, so results match a per-point loop to within rounding.
+
+// AoS {x, y} points
+inline void TransformAffine2D(std::span<const Vec2> in, std::span<Vec2> out, const Affine2D& t) {
+    const std::size_t n = std::min(in.size(), out.size());
+    std::size_t i = 0;
+#if defined(SGL_MATH_SSE) || defined(SGL_MATH_NEON)
+    const float* src = reinterpret_cast<const float*>(in.data());
+    float* dst = reinterpret_cast<float*>(out.data());
+#endif
+#if defined(SGL_MATH_SSE)
+    const __m128 a = _mm_set1_ps(t.a), b = _mm_set1_ps(t.b), c = _mm_set1_ps(t.c), d = _mm_set1_ps(t.d);
+    const __m128 tx = _mm_set1_ps(t.tx), ty = _mm_set1_ps(t.ty);
+    for (; i + 4 <= n; i += 4) {
+        const __m128 p0 = _mm_loadu_ps(src + i * 2);
+        const __m128 p1 = _mm_loadu_ps(src + i * 2 + 4);
+        const __m128 x = _mm_shuffle_ps(p0, p1, _MM_SHUFFLE(2, 0, 2, 0));
+        const __m128 y = _mm_shuffle_ps(p0, p1, _MM_SHUFFLE(3, 1, 3, 1));
+        const __m128 ox = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, x), _mm_mul_ps(c, y)), tx);
+        const __m128 oy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(b, x), _mm_mul_ps(d, y)), ty);
+        _mm_storeu_ps(dst + i * 2, _mm_unpacklo_ps(ox, oy));
+        _mm_storeu_ps(dst + i * 2 + 4, _mm_unpackhi_ps(ox, oy));
+    }
+#elif defined(SGL_MATH_NEON)
+    for (; i + 4 <= n; i += 4) {
+        const float32x4x2_t p = vld2q_f32(src + i * 2);
+        float32x4x2_t o;
+        o.val[0] = vaddq_f32(vaddq_f32(vmulq_n_f32(p.val[0], t.a), vmulq_n_f32(p.val[1], t.c)), vdupq_n_f32(t.tx));
+        o.val[1] = vaddq_f32(vaddq_f32(vmulq_n_f32(p.val[0], t.b), vmulq_n_f32(p.val[1], t.d)), vdupq_n_f32(t.ty));
+        vst2q_f32(dst + i * 2, o);
+    }
+#endif
+    for (; i < n; i++) out[i] = t.multiplyPoint(in[i]);
+}
+
+// SoA, separate x and y arrays
+inline void TransformAffine2D(std::span<const float> xs, std::span<const float> ys, std::span<float> outX, std::span<float> outY, const Affine2D& t) {
+    const std::size_t n = std::min({xs.size(), ys.size(), outX.size(), outY.size()});
+    std::size_t i = 0;
+#if defined(SGL_MATH_SSE)
+    const __m128 a = _mm_set1_ps(t.a), b = _mm_set1_ps(t.b), c = _mm_set1_ps(t.c), d = _mm_set1_ps(t.d);
+    const __m128 tx = _mm_set1_ps(t.tx), ty = _mm_set1_ps(t.ty);
+    for (; i + 4 <= n; i += 4) {
+        const __m128 x = _mm_loadu_ps(&xs[i]);
+        const __m128 y = _mm_loadu_ps(&ys[i]);
+        _mm_storeu_ps(&outX[i], _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, x), _mm_mul_ps(c, y)), tx));
+        _mm_storeu_ps(&outY[i], _mm_add_ps(_mm_add_ps(_mm_mul_ps(b, x), _mm_mul_ps(d, y)), ty));
+    }
+#elif defined(SGL_MATH_NEON)
+    for (; i + 4 <= n; i += 4) {
+        const float32x4_t x = vld1q_f32(&xs[i]);
+        const float32x4_t y = vld1q_f32(&ys[i]);
+        vst1q_f32(&outX[i], vaddq_f32(vaddq_f32(vmulq_n_f32(x, t.a), vmulq_n_f32(y, t.c)), vdupq_n_f32(t.tx)));
+        vst1q_f32(&outY[i], vaddq_f32(vaddq_f32(vmulq_n_f32(x, t.b), vmulq_n_f32(y, t.d)), vdupq_n_f32(t.ty)));
+    }
+#endif
+    for (; i < n; i++) {
+        const float x = xs[i], y = ys[i];
+        outX[i] = t.a * x + t.c * y + t.tx;
+        outY[i] = t.b * x + t.d * y + t.ty;
+    }
+}
+
+// 2D points through the x/y part of a Mat4, z = 0 and w ignored (fine for ortho and 2D model matrices)
+inline void TransformPoints(std::span<const Vec2> in, std::span<Vec2> out, const Mat4& m) {
+    TransformAffine2D(in, out, Affine2D::fromMat4(m));
+}
+
+// Parallel versions, worth it from roughly 100k points. threads = std::thread::hardware_concurrency() for all cores.
+inline void TransformAffine2D(std::span<const Vec2> in, std::span<Vec2> out, const Affine2D& t, unsigned threads) {
+    ParallelFor(std::min(in.size(), out.size()), threads, 16384, [&](std::size_t begin, std::size_t end) {
+        TransformAffine2D(in.subspan(begin, end - begin), out.subspan(begin, end - begin), t);
+    });
+}
+inline void TransformPoints(std::span<const Vec2> in, std::span<Vec2> out, const Mat4& m, unsigned threads) {
+    TransformAffine2D(in, out, Affine2D::fromMat4(m), threads);
+}
 }  // namespace SmallGraphicsLayer::Math
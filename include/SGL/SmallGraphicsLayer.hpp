@@ -8,8 +8,12 @@
 #include "genshaders/sprite.glsl.h"
 
 #include <cstdint>
+#include <array>
+#include <span>
 #include <vector>
 #include <iostream>
+#include <optional>
+#include <string>
 #include <unordered_map>
 
 namespace SmallGraphicsLayer {
@@ -31,6 +35,90 @@ struct Colours {
     static constexpr Colour Orange = {1, 0.5, 0, 1};
 };
 
+// Draws recorded as packets with a 64-bit sort key, then replayed in key order by Flush(). Replay skips
+// pipeline, bindings and uniform applications that match the previous packet. Device::Refresh() flushes
+// Device::Queue() before ending the pass, any other queue is flushed by hand inside a pass.
+// Every renderer records into a queue with Submit() (BatchedSprite with End(queue)), so layers order
+// draws across renderer types. Packets hold raw sokol handles. Renderers free replaced objects with
+// Device::Retire(), so a packet stays valid until the end of the frame that replays it.
+// Submit() and Record() never call sokol, so worker threads can each fill their own queue as a command
+// list and the render thread merges them with Merge() or Record() before flushing.
+class RenderQueue {
+public:
+    // layer (8 bits) | pipeline (16) | texture (16) | depth (24), high to low. Layers come first, then draws
+    // group by state, and lower depth draws first within a state. Blended draws whose overlap matters
+    // across pipelines or textures belong in separate layers.
+    static std::uint64_t MakeKey(std::uint8_t layer, sg_pipeline pipeline, sg_view texture, float depth = 0.f);
+
+    // Counters for the last Flush(), applications actually issued
+    struct Stats {
+        std::uint32_t packets   = 0;
+        std::uint32_t pipelines = 0;
+        std::uint32_t bindings  = 0;
+        std::uint32_t uniforms  = 0;
+        std::size_t instance_bytes = 0;
+    };
+
+    void Submit(std::uint64_t key, sg_pipeline pipeline, const sg_bindings& bindings, int base, int count, int instances = 1);
+    // Like Submit(), with per-instance vertex data copied into the queue. Flush() uploads the data of every
+    // packet in one append and points vertex buffer `bufferSlot` at this packet's part of it.
+    void SubmitInstances(std::uint64_t key, sg_pipeline pipeline, const sg_bindings& bindings, int bufferSlot,
+                         const sg_range& instanceData, int base, int count, int instances);
+    // Copies a uniform block for the last Submit()
+    void Uniforms(int slot, const sg_range& data);
+
+    // Orders packets by key, ties keep submission order. Safe on worker threads, Flush() sorts if needed.
+    void Sort();
+    // Moves every packet of `lists` into this queue and clears them. Equal keys replay in the order
+    // (this queue, lists[0], lists[1], ...) then submission order, so the result never depends on
+    // which thread finished first.
+    void Merge(std::span<RenderQueue> lists);
+    // Runs record(index, lists[index]) for every list on up to `threads` workers, sorts each list on the
+    // worker that filled it, then merges them into this queue.
+    template <typename Fn>
+    void Record(std::span<RenderQueue> lists, unsigned threads, Fn&& record) {
+        Math::ParallelFor(lists.size(), threads, 1, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t i = begin; i < end; i++) {
+                record(i, lists[i]);
+                lists[i].Sort();
+            }
+        });
+        Merge(lists);
+    }
+
+    void Flush();
+    void Clear();
+    // Releases the instance buffer, only queues that have flushed instance data own one
+    void Destroy();
+    std::size_t Size() const { return packets.size(); }
+    const Stats& GetStats() const { return stats; }
+private:
+    struct UniformBlock {
+        int slot;
+        std::uint32_t offset, size;  // into uniform_data
+    };
+    struct Packet {
+        std::uint64_t key;
+        sg_pipeline pipeline;
+        sg_bindings bindings;
+        int base, count, instances;
+        std::uint32_t first_uniform, uniform_count;
+        int instance_slot = -1;  // vertex buffer slot fed from instance_data, -1 when none
+        std::uint32_t instance_offset = 0;
+    };
+
+    std::vector<Packet> packets;
+    std::vector<UniformBlock> uniform_blocks;
+    std::vector<std::uint8_t> uniform_data;
+    std::vector<std::uint8_t> instance_data;  // 4-byte aligned per packet, as sokol wants for buffer offsets
+    std::vector<std::uint32_t> order;  // packets in replay order once sorted
+    bool sorted = true;
+    Stats stats;
+
+    sg_buffer instance_buffer = {};
+    std::size_t instance_capacity = 0;
+};
+
 class Device {
 public:
     // Consider a singleton accessor pattern in the future
@@ -42,12 +130,98 @@ public:
     static float Width()  { return width;  }
     static float Height() { return height; }
     static Math::Vec2 FrameSize() { return {static_cast<float>(width), static_cast<float>(height)}; };
+    // Shared queue, replayed by Refresh()
+    static RenderQueue& Queue() { return queue; }
+    // The default pixel projection as a 2D affine, rebuilt once per frame by Clear()
+    static const Math::Affine2D& Projection2D() { return projection_2d; }
+    // Destroys an object at the end of the frame, after Refresh() has replayed the queued draws.
+    // Renderers free replaced or destroyed objects through these, so packets already in a RenderQueue
+    // never reference a dead handle.
+    static void Retire(sg_buffer buffer);
+    static void Retire(sg_image image);
+    static void Retire(sg_view view);
+    static void Retire(sg_pipeline pipeline);
+    static void Retire(sg_shader shader);
+    static void Retire(sg_sampler sampler);
 private:
     static std::uint32_t width, height;
+    static Math::Affine2D projection_2d;
+    static RenderQueue queue;
+
+    struct Retired {
+        std::vector<sg_buffer> buffers;
+        std::vector<sg_image> images;
+        std::vector<sg_view> views;
+        std::vector<sg_pipeline> pipelines;
+        std::vector<sg_shader> shaders;
+        std::vector<sg_sampler> samplers;
+    };
+    static Retired retired;
+    static void destroy_retired();
     sg_pass_action pass_action = {};
     sg_swapchain swapchain = {};
 };
 
+// Device level cache of sokol objects shared between renderers. Identical descriptors
+// resolve to one ref-counted object, release it with the matching Release() call.
+// Descriptors are compared field by field, labels ignored and strings by content.
+class ResourceCache {
+public:
+    static sg_shader AcquireShader(const sg_shader_desc& desc);
+    static sg_pipeline AcquirePipeline(const sg_pipeline_desc& desc);
+    static sg_sampler AcquireSampler(const sg_sampler_desc& desc);
+    static void Release(sg_shader shader);
+    static void Release(sg_pipeline pipeline);
+    static void Release(sg_sampler sampler);
+
+    static std::size_t ShaderCount()   { return shaders.entries.size(); }
+    static std::size_t PipelineCount() { return pipelines.entries.size(); }
+    static std::size_t SamplerCount()  { return samplers.entries.size(); }
+
+    // Destroys everything still cached, called by Device::Shutdown()
+    static void Clear();
+private:
+    template <typename T>
+    struct Pool {
+        struct Entry { T handle; std::uint32_t refs; };
+        std::unordered_map<std::string, Entry> entries;  // by descriptor key
+        std::unordered_map<std::uint32_t, std::string> keys;  // sokol id -> descriptor key
+    };
+
+    template <typename T, typename Make>
+    static T acquire(Pool<T>& pool, std::string key, Make make);
+    template <typename T>
+    static void release(Pool<T>& pool, T handle, void (*destroy)(T));
+
+    static Pool<sg_shader> shaders;
+    static Pool<sg_pipeline> pipelines;
+    static Pool<sg_sampler> samplers;
+};
+
+// Immutable geometry every renderer binds instead of allocating its own, built by Device::Init()
+class GeometryPool {
+public:
+    // 16-bit indices address at most 65536 vertices
+    static constexpr std::uint32_t MaxQuads = 65536 / 4;
+
+    static void Init();
+    static void Shutdown();
+
+    // 4 vertices of {x, y, u, v} floats covering [0, 1]
+    static sg_buffer UnitQuad() { return unit_quad; }
+    // 4 vertices of {x, y, u, v} floats covering [-0.5, 0.5], uv still [0, 1]
+    static sg_buffer CentredQuad() { return centred_quad; }
+    // 3 vertices of {x, y} NDC floats that cover the whole viewport
+    static sg_buffer FullscreenTriangle() { return fullscreen_triangle; }
+    // uint16 indices {0, 1, 2, 2, 3, 0} repeated for MaxQuads quads of 4 vertices each
+    static sg_buffer QuadIndices() { return quad_indices; }
+private:
+    static sg_buffer unit_quad;
+    static sg_buffer centred_quad;
+    static sg_buffer fullscreen_triangle;
+    static sg_buffer quad_indices;
+};
+
 inline Math::Mat4 GetDefaultProjection() {
     return Math::Mat4::ortho(0.0f, Device::Width(), Device::Height(), 0.0f, -1.0f, 1.0f);
 }
@@ -55,7 +229,10 @@ inline Math::Mat4 GetDefaultProjection() {
 enum class RendererType {
     Attribute,  // basic attributes
     Single,     // sprites that render individually with one call
-    Instanced   // more efficient instanced sprite rendering
+    Instanced,  // more efficient instanced sprite rendering
+    Batched,    // CPU batched sprites, one draw call per texture run
+    TileMap,        // static instanced tiles, uploaded per chunk and culled by chunk
+    IndexedTileMap  // grid tiles looked up per pixel from an index texture, one draw per layer
 };
 
 class Renderer {
@@ -79,6 +256,9 @@ enum class UniformType {
 // Custom shader program for AttributeBuilder
 class AttributeProgram {
 public:
+    // vertex stage mvp, the fragment uniforms keep slot 0
+    static constexpr int VertexUniformSlot = 1;
+
     typedef struct {
         float resolution[2];
         float time;
@@ -103,8 +283,15 @@ enum class Primitives {
     Quad
 };
 
+// Vertex colour storage for AttributeBuilder
+enum class ColourFormat {
+    Float4,  // 4 floats, 28 byte vertices
+    UNorm8   // packed RGBA8 (SG_VERTEXFORMAT_UBYTE4N), 16 byte vertices
+};
+
 typedef Math::Vec3 Position;
-struct Index { std::uint16_t x, y, z; };
+// 32-bit so large meshes can be addressed, AttributeBuilder narrows to 16-bit when the mesh allows it
+struct Index { std::uint32_t x, y, z; };
 
 // Basic primitve and attribute renderer
 class AttributeBuilder final : public Renderer {
@@ -120,13 +307,27 @@ public:
         use_custom_fragment = true;
     }
 
+    // Clears any previous geometry
     AttributeBuilder& Begin(Primitives primative);
     AttributeBuilder& Vertex(Position pos, Colour col = Colours::Black, bool useNDC = false);
+    // Bulk submission, colours holds either one colour per position or a single colour for all of them
+    AttributeBuilder& Vertices(std::span<const Position> positions, std::span<const Colour> colours, bool useNDC = false);
     AttributeBuilder& Index(Index index);
+
+    // Keeps positions in pixels and maps them to NDC in the vertex shader instead of on the CPU.
+    // Every vertex is then treated as pixels, the per-vertex useNDC flag no longer applies.
+    void SetGPUTransform(bool enable) { gpu_transform = enable; }
+    // For geometry rebuilt every frame: End() reuses stream buffers (grown geometrically) instead of
+    // creating new immutable ones. sokol allows one such upload per frame, so call End() once per frame.
+    void SetStreaming(bool enable) { streaming = enable; }
+    // Takes effect from the next Begin(). UNorm8 suits flat-coloured geometry, colours are quantised to 8 bits.
+    void SetColourFormat(ColourFormat format) { next_colour_format = format; }
     
     void End();
     void Draw() const;
     void Draw(AttributeProgram program) const;
+    // Queues the same draw as Draw(), builders with a custom fragment program use Draw(program)
+    void Submit(RenderQueue& queue, std::uint8_t layer = 0, float depth = 0.f) const;
     void Destroy() override;
     
     RendererType Type() const override { return RendererType::Attribute; }
@@ -140,30 +341,48 @@ private:
     int elements;
     int chunks;
     int expected_chunks;
-    std::vector<float> vertices;
-    std::vector<std::uint16_t> indices;
+    int draw_count = 0;
+    // 4-byte words, floats are copied in so a packed colour never passes through a float register
+    std::vector<std::uint32_t> vertices;
+    std::vector<std::uint32_t> indices;
+    std::vector<std::uint16_t> indices16;  // narrowed copy uploaded when every index fits
 
     bool enable_ndc;
+    bool gpu_transform = false;
+    bool streaming = false;
 
     bool use_custom_fragment;
     AttributeProgram program;
+    // words per vertex, a packed colour takes one
+    std::size_t vertex_words() const { return colour_format == ColourFormat::UNorm8 ? 4 : 7; }
+
+    void select_pipeline(sg_index_type indexType);
+    sg_index_type pipeline_index_type = _SG_INDEXTYPE_DEFAULT;  // index type the current pipeline was built for
+    ColourFormat pipeline_colour_format = ColourFormat::Float4;
+    ColourFormat colour_format = ColourFormat::Float4;
+    ColourFormat next_colour_format = ColourFormat::Float4;
 
     Math::Vec2 framebuf;
 
     sg_buffer vbuf = {};
     sg_buffer ibuf = {};
+    std::size_t vbuf_capacity = 0;  // bytes, streaming only
+    std::size_t ibuf_capacity = 0;
 };
 
 // Single sprite renderer, uses one draw call per sprite
 class Sprite final : public Renderer {
 public:
     Sprite(std::tuple<int, int, unsigned char*> data);
-    void Update(Math::Vec2 position, Math::Vec2 origin, Math::Vec2 scale);
+    // projection is any 2D view-projection, eg. Device::Projection2D() * camera
+    void Update(Math::Vec2 position, Math::Vec2 origin, Math::Vec2 scale, const Math::Affine2D& projection = Device::Projection2D());
     void Draw() const;
     void Render(const Math::Vec2 position, const Math::Vec2 origin = {0, 0}, const Math::Vec2 scale = {1, 1}) {
         Update(position, origin, scale);
         Draw();
     }
+    // Queues a draw with the transform from the last Update(), so one Sprite can be submitted at several places
+    void Submit(RenderQueue& queue, std::uint8_t layer = 0, float depth = 0.f) const;
     void Destroy() override;
 
     RendererType Type() const override { return RendererType::Single; }
@@ -172,8 +391,6 @@ public:
     float Height() const { return size.y; }
 private:
     sg_image image = {};
-    sg_buffer vbuf = {};
-    sg_buffer ibuf = {};
     sprite_params_t params;
     Math::Vec2 size;
 };
@@ -182,32 +399,142 @@ inline Math::Vec2 get_tile_uv(const Math::Vec2 tileIndex, const Math::Vec2 tileS
     return Math::Vec2(tileIndex.x * tileSize.x / static_cast<float>(atlasSize.x), tileIndex.y * tileSize.y / static_cast<float>(atlasSize.y));
 }
 
+enum class InstanceStream {
+    Update,  // one sg_update_buffer per frame, Update() may only run once per frame
+    Append   // sg_append_buffer ring, several Update()/Draw() pairs per frame share the buffer
+};
+
+enum class InstanceFormat {
+    Float,   // 32 bytes per instance, sub-pixel offsets and any atlas size
+    Compact  // 12 bytes per instance, whole-pixel offsets in int16 range and atlases up to 65535 pixels
+};
+
+enum class InstanceSort {
+    None,  // push order, Remove() swaps the last instance into the gap
+    Y,     // back to front by the bottom edge of each instance, for top down and isometric scenes
+    Key    // back to front by SetSortKey(), ties keep their previous order
+};
+
+// Stable reference to an instance, stays valid until the instance is removed
+struct InstanceHandle {
+    std::uint32_t slot = UINT32_MAX;
+    std::uint32_t generation = 0;
+};
+
+// Uniform grid of rects {x, y, w, h} keyed by small caller ids (eg. instance handle slots).
+// A rect is listed in every cell it touches, moves only touch the grid when the cell range changes.
+class SpatialGrid {
+public:
+    explicit SpatialGrid(float cellSize = 256.f) : cell_size(cellSize), inv_cell(1.f / cellSize) {}
+
+    void Insert(std::uint32_t id, Math::Vec4 rect);
+    // Inserts when id isn't in the grid yet
+    void Move(std::uint32_t id, Math::Vec4 rect);
+    void Remove(std::uint32_t id);
+    void Clear();
+    bool Contains(std::uint32_t id) const { return id < items.size() && items[id].live; }
+
+    // Appends every id whose rect overlaps rect, each once. Costs the cells covered plus the results.
+    void Query(Math::Vec4 rect, std::vector<std::uint32_t>& out) const;
+
+    float CellSize() const { return cell_size; }
+private:
+    struct CellRange { int x0, y0, x1, y1; };
+    struct Item {
+        Math::Vec4 rect;
+        CellRange cells;
+        bool live = false;
+    };
+
+    CellRange cells_for(const Math::Vec4& rect) const;
+    void link(std::uint32_t id, const CellRange& range);
+    void unlink(std::uint32_t id, const CellRange& range);
+
+    float cell_size, inv_cell;
+    std::unordered_map<std::uint64_t, std::vector<std::uint32_t>> cells;
+    std::vector<Item> items;  // by id
+    // Query() dedupes multi-cell items by stamping them
+    mutable std::vector<std::uint32_t> stamps;
+    mutable std::uint32_t query_stamp = 0;
+};
+
 // GPU sprite instancing
 class InstancedSprite final : public Renderer {
 public:
-    void Reserve(const std::size_t cap) { instances.reserve(cap); }
-    void PushData(const Math::Vec2 offset, const Math::Vec2 tile_index, Math::Vec2 tile_size = {0, 0}) {
-        instances.push_back(create_instance_data(offset, tile_index, tile_size));
+    void Reserve(const std::size_t cap) {
+        instances.reserve(cap);
+        dense_slots.reserve(cap);
+        sort_keys.reserve(cap);
     }
-
-    InstancedSprite(std::tuple<int, int, unsigned char*> data, Math::Vec2 tileSize, std::uint16_t maxInstances = 4096);
+    // Removes every instance, all handles become invalid
+    void Clear();
+    InstanceHandle PushData(const Math::Vec2 offset, const Math::Vec2 tile_index, Math::Vec2 tile_size = {0, 0});
+    // Replaces an instance in place, only its span is uploaded by the next Update()
+    void Update(InstanceHandle handle, const Math::Vec2 offset, const Math::Vec2 tile_index, Math::Vec2 tile_size = {0, 0});
+    // Swaps the last instance into the removed one's place, draw order is not kept
+    void Remove(InstanceHandle handle);
+    bool Valid(InstanceHandle handle) const {
+        return handle.slot < generations.size() && generations[handle.slot] == handle.generation && sparse[handle.slot] != UINT32_MAX;
+    }
+    std::size_t Count() const { return instances.size(); }
+    // Only upload and draw instances whose rect overlaps the view of the last Update()
+    void SetCulling(bool enabled);
+    // Instances drawn by the last Update(), Count() unless culling
+    std::size_t VisibleCount() const { return visible_count; }
+    // Keeps a SpatialGrid of instance rects in step with PushData/Update/Remove,
+    // culling and QueryRect() then cost what they return instead of Count()
+    void EnableSpatialIndex(float cellSize = 256.f);
+    void DisableSpatialIndex() { grid.reset(); }
+    // Appends the handles of instances overlapping rect {x, y, w, h} in world space
+    void QueryRect(Math::Vec4 rect, std::vector<InstanceHandle>& out) const;
+    // Reorders instances every Update(). A nearly unchanged order is fixed up by insertion sort,
+    // anything else is radix sorted, split over `threads` workers for large counts.
+    void SetSort(InstanceSort mode, unsigned threads = 1);
+    void SetSortKey(InstanceHandle handle, float key);
+    // Time the last Update() spent sorting
+    double SortMs() const { return sort_ms; }
+    // Bytes sent to the GPU by the last Update(), 0 when nothing changed
+    std::size_t UploadedBytes() const { return uploaded_bytes; }
+
+    // maxInstances is the initial capacity, buffers grow geometrically as more instances are pushed.
+    // Past the per-buffer limit instances spill into further buffers, drawn with one call each.
+    InstancedSprite(std::tuple<int, int, unsigned char*> data, Math::Vec2 tileSize, std::uint32_t maxInstances = 4096,
+                    InstanceStream stream = InstanceStream::Update, InstanceFormat format = InstanceFormat::Float);
     void Update(Math::Mat4 projection, Math::Mat4 view);
     void Draw() const;
+    // Queues one packet per instance buffer with the data from the last Update()
+    void Submit(RenderQueue& queue, std::uint8_t layer = 0, float depth = 0.f) const;
     void Render(const Math::Mat4 &projection = GetDefaultProjection(), const Math::Mat4 &view = Math::Mat4(1.f)) {
         Update(projection, view);
         Draw();
     }
 
-    RendererType Type() const override { return RendererType::Instanced; }
-
-    void Destroy() override;
-private:
     struct InstanceData {
         Math::Vec2 offset;      // world-space X/Y
         Math::Vec2 uvOffset;    // which frame in the atlas
         Math::Vec2 worldScale;  // size of sprite in world eg. 64x32
         Math::Vec2 uvScale;     // size of sprite in uv space
     };
+    InstanceData MakeInstance(const Math::Vec2 offset, const Math::Vec2 tile_index, Math::Vec2 tile_size = {0, 0}) const {
+        return create_instance_data(offset, tile_index, tile_size);
+    }
+    // Queues `data` as one draw with its own copy of the instances, leaving this sprite's instances and
+    // buffers alone. Safe on worker threads as long as each records into its own queue.
+    void Record(RenderQueue& queue, std::span<const InstanceData> data, const Math::Mat4& mvp,
+                std::uint8_t layer = 0, float depth = 0.f) const;
+
+    RendererType Type() const override { return RendererType::Instanced; }
+
+    void Destroy() override;
+private:
+
+    // InstanceFormat::Compact upload layout, quantised from InstanceData when it is uploaded
+    struct CompactInstanceData {
+        std::int16_t offset[2];     // world-space X/Y in whole pixels
+        std::uint16_t uvOrigin[2];  // top left of the frame in atlas pixels
+        std::uint16_t size[2];      // size of sprite in pixels, in the world and the atlas
+    };
+    static_assert(sizeof(CompactInstanceData) == 12);
 
     InstanceData create_instance_data(const Math::Vec2 offset, const Math::Vec2 tileIndex, Math::Vec2 tileSize = {0, 0}) const {
         if (tileSize == Math::Vec2(0, 0)) {
@@ -226,20 +553,230 @@ private:
     }
     
     unsigned int w, h;
+    sg_image image = {};
     instance_params_t vs_params;
     Math::Vec2 tile_size;
+    // Kept below D3D11's 128MB resource limit and sokol's int buffer offsets
+    static constexpr std::size_t max_chunk_instances = (std::size_t{128} << 20) / sizeof(InstanceData);
+
+    // One GPU instance buffer covering instances [index * max_chunk_instances, ...)
+    struct InstanceChunk {
+        sg_buffer buffer = {};
+        std::size_t capacity = 0;
+        // sokol's sg_update_buffer always writes from offset 0 and rotates between SG_NUM_INFLIGHT_FRAMES
+        // backing buffers, so a slot only needs the prefix up to the furthest change since it was last written
+        std::array<std::size_t, SG_NUM_INFLIGHT_FRAMES> slot_dirty_end;
+        int active_slot = 0;
+        int offset = 0;      // append offset read by Draw()
+        int draw_count = 0;  // instances uploaded by the last Update()
+    };
+
+    void mark_dirty(const std::size_t first, const std::size_t count);
+    void grow_chunks(const std::size_t count);
+    void resize_chunk(InstanceChunk& chunk, const std::size_t capacity);
+    std::size_t instance_stride() const {
+        return format == InstanceFormat::Compact ? sizeof(CompactInstanceData) : sizeof(InstanceData);
+    }
+    // Upload range for count instances from src, packed into `packed` for the compact format
+    sg_range instance_range(const InstanceData* src, const std::size_t count);
+    // Quantises count instances into out, returns whether any value was clamped
+    bool pack_compact(const InstanceData* src, const std::size_t count, CompactInstanceData* out) const;
+    // Packs the instances overlapping the NDC square under mvp to the front of `visible`, returns how many
+    std::size_t cull(const Math::Affine2D& mvp);
+    // world-space {x, y, w, h} of an instance, w and h kept positive
+    static Math::Vec4 instance_rect(const InstanceData& inst) {
+        return {std::min(inst.offset.x, inst.offset.x + inst.worldScale.x), std::min(inst.offset.y, inst.offset.y + inst.worldScale.y),
+                std::fabs(inst.worldScale.x), std::fabs(inst.worldScale.y)};
+    }
+
     std::vector<InstanceData> instances = {};
-    bool dirty = false;
+    bool dirty = false;  // changed since the last upload
+    std::vector<InstanceChunk> chunks;
+
+    // handle slot -> dense index (UINT32_MAX when free), and dense index -> handle slot
+    std::vector<std::uint32_t> sparse;
+    std::vector<std::uint32_t> generations;
+    std::vector<std::uint32_t> free_slots;
+    std::vector<std::uint32_t> dense_slots;
+    std::size_t uploaded_bytes = 0;
+
+    InstanceStream stream;
+    InstanceFormat format;
+    std::vector<CompactInstanceData> packed;
+    bool warned_range = false;
+
+    bool culling = false;
+    std::vector<InstanceData> visible;
+    Math::Mat4 culled_mvp;  // view the current upload was culled against
+    std::size_t visible_count = 0;
+
+    std::optional<SpatialGrid> grid;
+    mutable std::vector<std::uint32_t> query_ids;
+
+    void sort_instances();
+    InstanceSort sort_mode = InstanceSort::None;
+    unsigned sort_threads = 1;
+    std::vector<float> sort_keys;  // dense, for InstanceSort::Key
+    std::vector<std::uint64_t> sort_items, sort_scratch;
+    // instances that moved this sort, and where to
+    std::vector<InstanceData> sorted_instances;
+    std::vector<std::uint32_t> sorted_slots;
+    std::vector<float> sorted_keys;
+    std::vector<std::uint32_t> sorted_at;
+    double sort_ms = 0;
+};
+
+// Static tile layer drawn with the instance shader. The map is cut into ChunkSize x ChunkSize chunks,
+// each uploaded once into an immutable instance buffer and only drawn while it overlaps the view.
+// Editing a tile rebuilds its chunk on the next Update(). Tiles draw row by row within a chunk and
+// chunks draw row by row, so overlapping (eg. isometric) tiles stay in order. Use one TileMap per layer.
+class TileMap final : public Renderer {
+public:
+    static constexpr int ChunkSize = 32;
+
+    // width x height tiles of tileSize pixels from the atlas in data
+    TileMap(std::tuple<int, int, unsigned char*> data, Math::Vec2 tileSize, int width, int height);
+
+    // Places atlas tile tileIndex at {x * tileSize.x, y * tileSize.y}
+    void SetTile(int x, int y, Math::Vec2 tileIndex);
+    // Places atlas tile tileIndex at a world offset, for isometric or staggered layouts
+    void SetTile(int x, int y, Math::Vec2 tileIndex, Math::Vec2 offset);
+    void ClearTile(int x, int y);
+
+    void Update(const Math::Mat4 &projection, const Math::Mat4 &view);
+    void Draw() const;
+    // Queues the chunks drawn by Draw() under one key, so their row order is kept
+    void Submit(RenderQueue& queue, std::uint8_t layer = 0, float depth = 0.f) const;
+    void Render(const Math::Mat4 &projection = GetDefaultProjection(), const Math::Mat4 &view = Math::Mat4(1.f)) {
+        Update(projection, view);
+        Draw();
+    }
+
+    int Width()  const { return width; }
+    int Height() const { return height; }
+    // Chunks drawn by the last Update() and chunks rebuilt by it
+    std::size_t VisibleChunks() const { return visible.size(); }
+    std::size_t RebuiltChunks() const { return rebuilt; }
+
+    RendererType Type() const override { return RendererType::TileMap; }
+    void Destroy() override;
+private:
+    struct Tile {
+        Math::Vec2 offset;
+        Math::Vec2 index;
+        bool used = false;
+    };
+    struct Chunk {
+        sg_buffer buffer = {};
+        int count = 0;
+        Math::Vec4 bounds;  // world-space {x0, y0, x1, y1} of its tiles
+        bool dirty = false;
+    };
+
+    void set_tile(int x, int y, const Tile& tile);
+    void rebuild(std::size_t chunk_index);
+
+    int width, height;
+    int chunks_x, chunks_y;
+    Math::Vec2 tile_size;
+    Math::Vec2 atlas_size;
+    sg_image image = {};
+    instance_params_t vs_params;
+
+    std::vector<Tile> tiles;
+    std::vector<Chunk> chunks;
+    std::vector<std::uint32_t> visible;
+    // InstancedSprite's layout, both draw through the same instance pipeline
+    std::vector<InstancedSprite::InstanceData> scratch;
+    std::size_t rebuilt = 0;
+};
+
+// Orthogonal tile layer drawn as one fullscreen triangle. Tile indices live in an RG8UI texture with
+// one texel per cell, and the fragment shader turns each pixel's cell into an atlas UV (the get_tile_uv
+// convention). The GPU cost is per screen pixel and the CPU cost per frame is constant, at any map size.
+// Tiles are tileSize pixels on a grid from Position(), atlas tile indices go up to 254 on each axis.
+class IndexedTileMap final : public Renderer {
+public:
+    IndexedTileMap(std::tuple<int, int, unsigned char*> data, Math::Vec2 tileSize, int width, int height);
+
+    void SetTile(int x, int y, Math::Vec2 tileIndex);
+    void ClearTile(int x, int y);
+    // World position of the map's top left corner
+    void SetPosition(Math::Vec2 position) { this->position = position; }
+    Math::Vec2 Position() const { return position; }
+
+    void Update(const Math::Mat4 &projection, const Math::Mat4 &view);
+    void Draw() const;
+    void Submit(RenderQueue& queue, std::uint8_t layer = 0, float depth = 0.f) const;
+    void Render(const Math::Mat4 &projection = GetDefaultProjection(), const Math::Mat4 &view = Math::Mat4(1.f)) {
+        Update(projection, view);
+        Draw();
+    }
+
+    int Width()  const { return width; }
+    int Height() const { return height; }
+
+    RendererType Type() const override { return RendererType::IndexedTileMap; }
+    void Destroy() override;
+private:
+    static constexpr std::uint8_t empty_tile = 255;
+
+    int width, height;
+    Math::Vec2 tile_size;
+    Math::Vec2 atlas_size;
+    Math::Vec2 position = {0, 0};
+    sg_image atlas = {};
+    sg_image index = {};
+    std::vector<std::uint8_t> cells;  // {column, row} per tile, row-major
+    bool dirty = true;
+    bool visible = false;
+    float vs_params[8];  // inverse view-projection as an Affine2D
+    float fs_params[8];  // tile size, map size, atlas size, position
+};
+
+enum class BatchMode {
+    Immediate,  // draw in submission order, flushing on every texture switch
+    Sorted      // gather until End(), then draw sorted by (layer, texture)
 };
 
 // CPU sprite batching
-class BatchedSprite : public Renderer {
+class BatchedSprite final : public Renderer {
 public:
-    BatchedSprite();
+    // Counters for the current Begin()/End() pair, useful for checking how well sprites batch
+    struct Stats {
+        std::uint32_t sprites         = 0;  // sprites submitted
+        std::uint32_t flushes         = 0;  // draw calls issued
+        std::uint32_t texture_flushes = 0;  // flushes caused by a texture switch
+        std::uint32_t full_flushes    = 0;  // flushes caused by a full batch
+        std::uint32_t largest_batch   = 0;  // most sprites drawn by a single flush
+        std::size_t   upload_bytes    = 0;  // vertex bytes streamed to the GPU
+        double        sort_ms         = 0;  // time spent sorting in BatchMode::Sorted
+    };
 
-    void Begin();
-    void Draw();
+    // maxSprites sizes the per-frame vertex stream, it grows if a frame needs more
+    BatchedSprite(std::uint32_t maxSprites = 16384, BatchMode mode = BatchMode::Immediate);
+
+    // Uploads an image the batch can draw from, returns its texture slot
+    std::uint16_t AddTexture(std::tuple<int, int, unsigned char*> data);
+    Math::Vec2 TextureSize(std::uint16_t texture) const { return textures[texture].size; }
+
+    void Begin(const Math::Mat4 &projection = GetDefaultProjection(), const Math::Mat4 &view = Math::Mat4(1.f));
+    // Layer for the following draws (BatchMode::Sorted only). Lower layers draw first and
+    // submission order is kept per texture within a layer, so anything whose overlap
+    // matters across textures belongs in separate layers. Begin() resets it to 0.
+    void SetLayer(std::uint8_t layer) { current_layer = layer; }
+    // Draws the whole texture
+    void Draw(std::uint16_t texture, Math::Vec2 position, Math::Vec2 origin = {0, 0}, Math::Vec2 scale = {1, 1}, Colour tint = Colours::White);
+    // Draws a pixel region {x, y, w, h} of the texture
+    void Draw(std::uint16_t texture, Math::Vec4 region, Math::Vec2 position, Math::Vec2 origin = {0, 0}, Math::Vec2 scale = {1, 1}, Colour tint = Colours::White);
     void End();
+    // As End(), but each flush is queued instead of drawn. The flushes share one key, so the queue keeps
+    // the batch's own order. Vertices are still streamed here, so call it on the render thread.
+    void End(RenderQueue& queue, std::uint8_t layer = 0, float depth = 0.f);
+
+    const Stats& GetStats() const { return stats; }
+
+    RendererType Type() const override { return RendererType::Batched; }
 
     void Destroy() override;
 private:
@@ -249,7 +786,32 @@ private:
         std::uint32_t rgba;
     };
 
+    struct BatchTexture {
+        sg_image image;
+        sg_view view;
+        Math::Vec2 size;
+    };
+
+    enum class FlushReason { End, Texture, Full };
+    void emit(std::uint16_t texture, const Vertex* quad);
+    void flush(FlushReason reason);
+
+    std::vector<BatchTexture> textures;
     std::vector<Vertex> vertices;
-    std::vector<std::uint16_t> indices;
+
+    BatchMode mode;
+    std::uint8_t current_layer = 0;
+    std::vector<Vertex> pending;          // 4 vertices per deferred sprite
+    std::vector<std::uint32_t> keys;      // layer << 16 | texture, per deferred sprite
+    std::vector<std::uint32_t> order;
+    std::vector<std::uint32_t> scratch;
+
+    std::uint32_t batch_quads;  // sprites per draw call, bound by 16-bit indices
+    std::size_t vbuf_size;
+    int current_texture = -1;
+    sprite_params_t params;
+    RenderQueue* target = nullptr;  // set while End(queue) flushes
+    std::uint64_t target_key = 0;
+    Stats stats;
 };
-}
+}
\ No newline at end of file
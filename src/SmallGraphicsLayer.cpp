@@ -8,33 +8,77 @@
 #endif
 
 #include <array>
+#include <algorithm>
+#include <barrier>
+#include <chrono>
+#include <cstring>
+#include <bit>
+#include <atomic>
+#include <functional>
+#include <queue>
+#include <tuple>
+
+inline sg_buffer make_immutable_buffer(const sg_range& data, bool index, const char* label) {
+    sg_buffer_desc desc = {};
+    desc.data = data;
+    desc.usage.vertex_buffer = !index;
+    desc.usage.index_buffer = index;
+    desc.usage.immutable = true;
+    desc.label = label;
+    return sg_make_buffer(&desc);
+}
 
-// TODO: Apply this everywhere where needed
-// Currently only used in Instanced Renderer
-inline sg_buffer make_ibuf() {
-    const std::uint16_t indices[] = { 0, 1, 2,  2, 3, 0 };
-    sg_buffer_desc ibuf_desc = {};
-    ibuf_desc.data = SG_RANGE(indices);
-    ibuf_desc.usage.index_buffer = true;
-    ibuf_desc.label = "indices";
-    return sg_make_buffer(&ibuf_desc);;
+// Uploads into a stream_update buffer, recreating it at double the size when data no longer fits
+inline void stream_upload(sg_buffer& buf, std::size_t& capacity, const sg_range& data, bool index, const char* label) {
+    if (data.size > capacity || buf.id == SG_INVALID_ID) {
+        SmallGraphicsLayer::Device::Retire(buf);
+        capacity = std::max(capacity * 2, data.size);
+        sg_buffer_desc desc = {};
+        desc.size = capacity;
+        desc.usage.vertex_buffer = !index;
+        desc.usage.index_buffer = index;
+        desc.usage.stream_update = true;
+        desc.label = label;
+        buf = sg_make_buffer(&desc);
+    }
+    sg_update_buffer(buf, &data);
 }
 
-inline sg_buffer make_unit_vbuf() {
-    const float vertices[] = {
-        0.0f, 0.0f,   0.0f, 0.0f,
-        1.0f, 0.0f,   1.0f, 0.0f,
-        1.0f, 1.0f,   1.0f, 1.0f,
-        0.0f, 1.0f,   0.0f, 1.0f
-    };
+// RGBA8 in memory order, as read by SG_VERTEXFORMAT_UBYTE4N
+inline std::uint32_t pack_colour(const sg_color& c) {
+    auto u8 = [](float f) { return static_cast<std::uint32_t>(std::clamp(f, 0.f, 1.f) * 255.f + 0.5f); };
+    return u8(c.r) | (u8(c.g) << 8) | (u8(c.b) << 16) | (u8(c.a) << 24);
+}
 
-    sg_buffer_desc vbuf_desc = {};
-    vbuf_desc.data = SG_RANGE(vertices);
-    vbuf_desc.usage.vertex_buffer = true;
-    // change if needed
-    vbuf_desc.usage.immutable = true;
-    vbuf_desc.label = "vertices";
-    return sg_make_buffer(&vbuf_desc);;
+// Float field of an interleaved vertex stored as a 4-byte word
+inline void store_float(std::uint32_t* out, float f) {
+    std::memcpy(out, &f, sizeof(float));
+}
+
+// Writes interleaved {x, y, z, r, g, b, a} vertices with x/y mapped by scale + offset.
+// colStride is 0 to repeat one colour. Straight-line loop over preallocated storage so it vectorises.
+inline void write_vertices(std::uint32_t* out, const SmallGraphicsLayer::Math::Vec3* pos, const sg_color* col, std::size_t colStride, std::size_t count,
+                           float sx, float ox, float sy, float oy) {
+    for (std::size_t i = 0; i < count; i++) {
+        const sg_color& c = col[i * colStride];
+        std::uint32_t* v = out + i * 7;
+        store_float(v + 0, pos[i].x * sx + ox);
+        store_float(v + 1, pos[i].y * sy + oy);
+        store_float(v + 2, pos[i].z);
+        store_float(v + 3, c.r); store_float(v + 4, c.g); store_float(v + 5, c.b); store_float(v + 6, c.a);
+    }
+}
+
+// As write_vertices, but writes {x, y, z, rgba8} with the packed colour as the 4th word
+inline void write_vertices_packed(std::uint32_t* out, const SmallGraphicsLayer::Math::Vec3* pos, const sg_color* col, std::size_t colStride, std::size_t count,
+                                  float sx, float ox, float sy, float oy) {
+    for (std::size_t i = 0; i < count; i++) {
+        std::uint32_t* v = out + i * 4;
+        store_float(v + 0, pos[i].x * sx + ox);
+        store_float(v + 1, pos[i].y * sy + oy);
+        store_float(v + 2, pos[i].z);
+        v[3] = pack_colour(col[i * colStride]);
+    }
 }
 
 inline void set_alpha_blend(sg_pipeline_desc& pip_desc) {
@@ -47,6 +91,360 @@ inline void set_alpha_blend(sg_pipeline_desc& pip_desc) {
     pip_desc.colors[0].blend.op_alpha         = SG_BLENDOP_ADD;
 }
 
+// Canonical bytes of a descriptor, written field by field so padding, labels and where a string
+// happens to live never affect the key. Strings go in by content with their length, null as a marker.
+class DescKey {
+public:
+    template <typename... Ts>
+    DescKey& add(const Ts&... values) {
+        (add_one(values), ...);
+        return *this;
+    }
+    std::string take() { return std::move(bytes); }
+private:
+    template <typename T>
+    void add_one(const T& value) {
+        static_assert(std::is_arithmetic_v<T> || std::is_enum_v<T>);
+        append(&value, sizeof(T));
+    }
+    void add_one(const char* str) {
+        const std::uint32_t size = str ? static_cast<std::uint32_t>(std::strlen(str)) : UINT32_MAX;
+        append(&size, sizeof(size));
+        if (str) append(str, size);
+    }
+    // injected native handles compare by identity
+    void add_one(const void* ptr) {
+        const auto value = reinterpret_cast<std::uintptr_t>(ptr);
+        append(&value, sizeof(value));
+    }
+    void add_one(const sg_range& range) {
+        add_one(range.size);
+        if (range.ptr) append(range.ptr, range.size);
+    }
+    void append(const void* data, std::size_t size) {
+        bytes.append(static_cast<const char*>(data), size);
+    }
+
+    std::string bytes;
+};
+
+inline sg_image make_image(std::tuple<int, int, unsigned char*> data) {
+    int w = std::get<0>(data), h = std::get<1>(data);
+    sg_image_desc img_desc = {};
+    img_desc.width = w;
+    img_desc.height = h;
+    img_desc.data.mip_levels[0].ptr = std::get<2>(data);
+    img_desc.data.mip_levels[0].size = static_cast<std::size_t>(w * h * 4);
+    return sg_make_image(img_desc);
+}
+
+// Hand written GLSL (like AttributeProgram) until the batch shader goes through sokol-shdc
+constexpr int ATTR_batch_pos       = 0;
+constexpr int ATTR_batch_texcoord0 = 1;
+constexpr int ATTR_batch_colour0   = 2;
+constexpr int UB_batch_params      = 0;
+constexpr int VIEW_batch_tex       = 0;
+constexpr int SMP_batch_smp        = 0;
+
+inline const sg_shader_desc* batch_shader_desc() {
+    static sg_shader_desc desc;
+    static bool valid;
+    if (!valid) {
+        valid = true;
+        desc.vertex_func.source =
+            "#version 410\n"
+            "uniform vec4 params[4];\n"
+            "layout(location=0) in vec2 pos;\n"
+            "layout(location=1) in vec2 texcoord0;\n"
+            "layout(location=2) in vec4 colour0;\n"
+            "out vec2 uv;\n"
+            "out vec4 colour;\n"
+            "void main() {\n"
+            "    gl_Position = mat4(params[0], params[1], params[2], params[3]) * vec4(pos, 0.0, 1.0);\n"
+            "    uv = texcoord0;\n"
+            "    colour = colour0;\n"
+            "}";
+        desc.fragment_func.source =
+            "#version 410\n"
+            "uniform sampler2D tex_smp;\n"
+            "in vec2 uv;\n"
+            "in vec4 colour;\n"
+            "out vec4 frag_color;\n"
+            "void main() {\n"
+            "    frag_color = texture(tex_smp, uv) * colour;\n"
+            "}";
+        desc.attrs[ATTR_batch_pos].glsl_name = "pos";
+        desc.attrs[ATTR_batch_texcoord0].glsl_name = "texcoord0";
+        desc.attrs[ATTR_batch_colour0].glsl_name = "colour0";
+        desc.uniform_blocks[UB_batch_params].stage = SG_SHADERSTAGE_VERTEX;
+        desc.uniform_blocks[UB_batch_params].layout = SG_UNIFORMLAYOUT_STD140;
+        desc.uniform_blocks[UB_batch_params].size = sizeof(sprite_params_t);
+        desc.uniform_blocks[UB_batch_params].glsl_uniforms[0].type = SG_UNIFORMTYPE_FLOAT4;
+        desc.uniform_blocks[UB_batch_params].glsl_uniforms[0].array_count = 4;
+        desc.uniform_blocks[UB_batch_params].glsl_uniforms[0].glsl_name = "params";
+        desc.views[VIEW_batch_tex].texture.stage = SG_SHADERSTAGE_FRAGMENT;
+        desc.views[VIEW_batch_tex].texture.image_type = SG_IMAGETYPE_2D;
+        desc.views[VIEW_batch_tex].texture.sample_type = SG_IMAGESAMPLETYPE_FLOAT;
+        desc.samplers[SMP_batch_smp].stage = SG_SHADERSTAGE_FRAGMENT;
+        desc.samplers[SMP_batch_smp].sampler_type = SG_SAMPLERTYPE_FILTERING;
+        desc.texture_sampler_pairs[0].stage = SG_SHADERSTAGE_FRAGMENT;
+        desc.texture_sampler_pairs[0].view_slot = VIEW_batch_tex;
+        desc.texture_sampler_pairs[0].sampler_slot = SMP_batch_smp;
+        desc.texture_sampler_pairs[0].glsl_name = "tex_smp";
+        desc.label = "batch_shader";
+    }
+    return &desc;
+}
+
+// Compact instance variant of instance-tex.glsl: integer pixel attributes, the atlas size turns them into uvs
+constexpr int ATTR_instance_compact_aPos      = 0;
+constexpr int ATTR_instance_compact_aUV       = 1;
+constexpr int ATTR_instance_compact_aOffset   = 2;
+constexpr int ATTR_instance_compact_aUVOrigin = 3;
+constexpr int ATTR_instance_compact_aSize     = 4;
+constexpr int UB_instance_compact_params      = 0;
+
+struct instance_compact_params_t {
+    SmallGraphicsLayer::Math::Mat4 mvp;
+    float inv_atlas_size[4];
+};
+
+inline const sg_shader_desc* instance_compact_shader_desc() {
+    static sg_shader_desc desc;
+    static bool valid;
+    if (!valid) {
+        valid = true;
+        desc.vertex_func.source =
+            "#version 410\n"
+            "uniform vec4 params[5];\n"
+            "layout(location=0) in vec2 aPos;\n"
+            "layout(location=1) in vec2 aUV;\n"
+            "layout(location=2) in ivec2 aOffset;\n"
+            "layout(location=3) in uvec2 aUVOrigin;\n"
+            "layout(location=4) in uvec2 aSize;\n"
+            "out vec2 vUV;\n"
+            "void main() {\n"
+            "    vec2 size = vec2(aSize);\n"
+            "    gl_Position = mat4(params[0], params[1], params[2], params[3]) * vec4(aPos * size + vec2(aOffset), 0.0, 1.0);\n"
+            "    vUV = (vec2(aUVOrigin) + aUV * size) * params[4].xy;\n"
+            "}";
+        desc.fragment_func.source =
+            "#version 410\n"
+            "uniform sampler2D tex_smp;\n"
+            "in vec2 vUV;\n"
+            "out vec4 FragColor;\n"
+            "void main() {\n"
+            "    FragColor = texture(tex_smp, vUV);\n"
+            "}";
+        desc.attrs[ATTR_instance_compact_aPos].glsl_name = "aPos";
+        desc.attrs[ATTR_instance_compact_aUV].glsl_name = "aUV";
+        desc.attrs[ATTR_instance_compact_aOffset].glsl_name = "aOffset";
+        desc.attrs[ATTR_instance_compact_aOffset].base_type = SG_SHADERATTRBASETYPE_SINT;
+        desc.attrs[ATTR_instance_compact_aUVOrigin].glsl_name = "aUVOrigin";
+        desc.attrs[ATTR_instance_compact_aUVOrigin].base_type = SG_SHADERATTRBASETYPE_UINT;
+        desc.attrs[ATTR_instance_compact_aSize].glsl_name = "aSize";
+        desc.attrs[ATTR_instance_compact_aSize].base_type = SG_SHADERATTRBASETYPE_UINT;
+        desc.uniform_blocks[UB_instance_compact_params].stage = SG_SHADERSTAGE_VERTEX;
+        desc.uniform_blocks[UB_instance_compact_params].layout = SG_UNIFORMLAYOUT_STD140;
+        desc.uniform_blocks[UB_instance_compact_params].size = sizeof(instance_compact_params_t);
+        desc.uniform_blocks[UB_instance_compact_params].glsl_uniforms[0].type = SG_UNIFORMTYPE_FLOAT4;
+        desc.uniform_blocks[UB_instance_compact_params].glsl_uniforms[0].array_count = 5;
+        desc.uniform_blocks[UB_instance_compact_params].glsl_uniforms[0].glsl_name = "params";
+        desc.views[VIEW_instance_tex].texture.stage = SG_SHADERSTAGE_FRAGMENT;
+        desc.views[VIEW_instance_tex].texture.image_type = SG_IMAGETYPE_2D;
+        desc.views[VIEW_instance_tex].texture.sample_type = SG_IMAGESAMPLETYPE_FLOAT;
+        desc.samplers[SMP_instance_smp].stage = SG_SHADERSTAGE_FRAGMENT;
+        desc.samplers[SMP_instance_smp].sampler_type = SG_SAMPLERTYPE_FILTERING;
+        desc.texture_sampler_pairs[0].stage = SG_SHADERSTAGE_FRAGMENT;
+        desc.texture_sampler_pairs[0].view_slot = VIEW_instance_tex;
+        desc.texture_sampler_pairs[0].sampler_slot = SMP_instance_smp;
+        desc.texture_sampler_pairs[0].glsl_name = "tex_smp";
+        desc.label = "instance_compact_shader";
+    }
+    return &desc;
+}
+
+// Hand written GLSL for IndexedTileMap, world positions are rebuilt from NDC with the inverse view-projection
+constexpr int ATTR_tilemap_pos    = 0;
+constexpr int UB_tilemap_vs       = 0;
+constexpr int UB_tilemap_fs       = 1;
+constexpr int VIEW_tilemap_atlas  = 0;
+constexpr int VIEW_tilemap_index  = 1;
+constexpr int SMP_tilemap_atlas   = 0;
+constexpr int SMP_tilemap_index   = 1;
+
+inline const sg_shader_desc* tilemap_shader_desc() {
+    static sg_shader_desc desc;
+    static bool valid;
+    if (!valid) {
+        valid = true;
+        desc.vertex_func.source =
+            "#version 410\n"
+            "uniform vec4 vs_params[2];\n"
+            "layout(location=0) in vec2 pos;\n"
+            "out vec2 world;\n"
+            "void main() {\n"
+            "    gl_Position = vec4(pos, 0.0, 1.0);\n"
+            "    world = vec2(vs_params[0].x * pos.x + vs_params[0].z * pos.y, vs_params[0].y * pos.x + vs_params[0].w * pos.y) + vs_params[1].xy;\n"
+            "}";
+        desc.fragment_func.source =
+            "#version 410\n"
+            "uniform vec4 fs_params[2];\n"
+            "uniform sampler2D atlas_smp;\n"
+            "uniform usampler2D index_smp;\n"
+            "in vec2 world;\n"
+            "out vec4 frag_color;\n"
+            "void main() {\n"
+            "    vec2 tile = fs_params[0].xy;\n"
+            "    vec2 local = world - fs_params[1].zw;\n"
+            "    vec2 cell = floor(local / tile);\n"
+            "    if (any(lessThan(cell, vec2(0.0))) || any(greaterThanEqual(cell, fs_params[0].zw))) discard;\n"
+            "    uvec2 index = texelFetch(index_smp, ivec2(cell), 0).xy;\n"
+            "    if (index.x == 255u) discard;\n"
+            "    vec2 uv = (vec2(index) * tile + (local - cell * tile)) / fs_params[1].xy;\n"
+            "    frag_color = textureLod(atlas_smp, uv, 0.0);\n"
+            "}";
+        desc.attrs[ATTR_tilemap_pos].glsl_name = "pos";
+        desc.uniform_blocks[UB_tilemap_vs].stage = SG_SHADERSTAGE_VERTEX;
+        desc.uniform_blocks[UB_tilemap_vs].layout = SG_UNIFORMLAYOUT_STD140;
+        desc.uniform_blocks[UB_tilemap_vs].size = 2 * 4 * sizeof(float);
+        desc.uniform_blocks[UB_tilemap_vs].glsl_uniforms[0].type = SG_UNIFORMTYPE_FLOAT4;
+        desc.uniform_blocks[UB_tilemap_vs].glsl_uniforms[0].array_count = 2;
+        desc.uniform_blocks[UB_tilemap_vs].glsl_uniforms[0].glsl_name = "vs_params";
+        desc.uniform_blocks[UB_tilemap_fs].stage = SG_SHADERSTAGE_FRAGMENT;
+        desc.uniform_blocks[UB_tilemap_fs].layout = SG_UNIFORMLAYOUT_STD140;
+        desc.uniform_blocks[UB_tilemap_fs].size = 2 * 4 * sizeof(float);
+        desc.uniform_blocks[UB_tilemap_fs].glsl_uniforms[0].type = SG_UNIFORMTYPE_FLOAT4;
+        desc.uniform_blocks[UB_tilemap_fs].glsl_uniforms[0].array_count = 2;
+        desc.uniform_blocks[UB_tilemap_fs].glsl_uniforms[0].glsl_name = "fs_params";
+        desc.views[VIEW_tilemap_atlas].texture.stage = SG_SHADERSTAGE_FRAGMENT;
+        desc.views[VIEW_tilemap_atlas].texture.image_type = SG_IMAGETYPE_2D;
+        desc.views[VIEW_tilemap_atlas].texture.sample_type = SG_IMAGESAMPLETYPE_FLOAT;
+        desc.views[VIEW_tilemap_index].texture.stage = SG_SHADERSTAGE_FRAGMENT;
+        desc.views[VIEW_tilemap_index].texture.image_type = SG_IMAGETYPE_2D;
+        desc.views[VIEW_tilemap_index].texture.sample_type = SG_IMAGESAMPLETYPE_UINT;
+        desc.samplers[SMP_tilemap_atlas].stage = SG_SHADERSTAGE_FRAGMENT;
+        desc.samplers[SMP_tilemap_atlas].sampler_type = SG_SAMPLERTYPE_FILTERING;
+        desc.samplers[SMP_tilemap_index].stage = SG_SHADERSTAGE_FRAGMENT;
+        desc.samplers[SMP_tilemap_index].sampler_type = SG_SAMPLERTYPE_NONFILTERING;
+        desc.texture_sampler_pairs[0].stage = SG_SHADERSTAGE_FRAGMENT;
+        desc.texture_sampler_pairs[0].view_slot = VIEW_tilemap_atlas;
+        desc.texture_sampler_pairs[0].sampler_slot = SMP_tilemap_atlas;
+        desc.texture_sampler_pairs[0].glsl_name = "atlas_smp";
+        desc.texture_sampler_pairs[1].stage = SG_SHADERSTAGE_FRAGMENT;
+        desc.texture_sampler_pairs[1].view_slot = VIEW_tilemap_index;
+        desc.texture_sampler_pairs[1].sampler_slot = SMP_tilemap_index;
+        desc.texture_sampler_pairs[1].glsl_name = "index_smp";
+        desc.label = "tilemap_shader";
+    }
+    return &desc;
+}
+
+// Stable LSD radix sort of [0, keys.size()) by key, 8 bits per pass.
+// Passes where every key shares the same digit are skipped, so small key ranges cost one or two passes.
+inline void radix_sort_indices(const std::vector<std::uint32_t>& keys, std::vector<std::uint32_t>& order, std::vector<std::uint32_t>& scratch) {
+    const std::size_t n = keys.size();
+    order.resize(n);
+    scratch.resize(n);
+    for (std::size_t i = 0; i < n; i++) order[i] = static_cast<std::uint32_t>(i);
+
+    for (int shift = 0; shift < 32; shift += 8) {
+        std::array<std::uint32_t, 256> counts = {};
+        for (std::size_t i = 0; i < n; i++) counts[(keys[i] >> shift) & 0xFF]++;
+        if (std::find(counts.begin(), counts.end(), static_cast<std::uint32_t>(n)) != counts.end()) continue;
+
+        std::uint32_t sum = 0;
+        for (auto& c : counts) {
+            const std::uint32_t c0 = c;
+            c = sum;
+            sum += c0;
+        }
+        for (std::size_t i = 0; i < n; i++) {
+            const std::uint32_t idx = order[i];
+            scratch[counts[(keys[idx] >> shift) & 0xFF]++] = idx;
+        }
+        order.swap(scratch);
+    }
+}
+
+// Stable LSD radix sort of (key << 32 | index) pairs by key, 11 bits per pass. Carrying the key with
+// its index keeps every pass a sequential read. Passes where every key shares a digit are skipped.
+// With threads > 1 and enough items each pass is split into contiguous blocks: workers count their
+// block, take their offsets from a prefix over (digit, worker) and scatter, which keeps it stable.
+inline void radix_sort_pairs(std::vector<std::uint64_t>& items, std::vector<std::uint64_t>& scratch, unsigned threads) {
+    constexpr int radix_bits = 11;
+    constexpr std::size_t buckets = std::size_t{1} << radix_bits;
+    constexpr std::size_t min_per_worker = 32768;
+    const std::size_t n = items.size();
+    scratch.resize(n);
+
+    const std::size_t workers = std::clamp<std::size_t>(threads, 1, std::max<std::size_t>(n / min_per_worker, 1));
+    if (workers == 1) {
+        // digit counts don't depend on order, one read fills every pass's histogram
+        constexpr int passes = (32 + radix_bits - 1) / radix_bits;
+        std::vector<std::array<std::uint32_t, buckets>> hist(passes);
+        for (auto& h : hist) h.fill(0);
+        for (const std::uint64_t item : items) {
+            for (int p = 0; p < passes; p++) hist[p][(item >> (32 + p * radix_bits)) & (buckets - 1)]++;
+        }
+        for (int p = 0; p < passes; p++) {
+            auto& offsets = hist[p];
+            if (std::find(offsets.begin(), offsets.end(), static_cast<std::uint32_t>(n)) != offsets.end()) continue;
+            std::uint32_t sum = 0;
+            for (auto& c : offsets) {
+                const std::uint32_t c0 = c;
+                c = sum;
+                sum += c0;
+            }
+            const int shift = 32 + p * radix_bits;
+            for (const std::uint64_t item : items) scratch[offsets[(item >> shift) & (buckets - 1)]++] = item;
+            items.swap(scratch);
+        }
+        return;
+    }
+
+    std::vector<std::array<std::uint32_t, buckets>> counts(workers);
+    std::barrier sync(static_cast<std::ptrdiff_t>(workers));
+    std::uint64_t* src = items.data();
+    std::uint64_t* dst = scratch.data();
+    int swaps = 0;
+
+    SmallGraphicsLayer::Math::ParallelFor(workers, static_cast<unsigned>(workers), 1, [&](std::size_t w, std::size_t) {
+        const std::size_t begin = n * w / workers;
+        const std::size_t end = n * (w + 1) / workers;
+        std::uint64_t* in = src;
+        std::uint64_t* out = dst;
+        for (int shift = 32; shift < 64; shift += radix_bits) {
+            auto& mine = counts[w];
+            mine.fill(0);
+            for (std::size_t i = begin; i < end; i++) mine[(in[i] >> shift) & (buckets - 1)]++;
+            sync.arrive_and_wait();
+
+            // every worker reaches the same answer, so they skip passes together
+            std::array<std::uint32_t, buckets> offsets;
+            std::uint32_t sum = 0;
+            bool trivial = false;
+            for (std::size_t d = 0; d < buckets; d++) {
+                std::uint32_t total = 0;
+                for (std::size_t k = 0; k < workers; k++) {
+                    if (k == w) offsets[d] = sum + total;
+                    total += counts[k][d];
+                }
+                trivial |= total == n;
+                sum += total;
+            }
+            if (!trivial) {
+                for (std::size_t i = begin; i < end; i++) out[offsets[(in[i] >> shift) & (buckets - 1)]++] = in[i];
+                std::swap(in, out);
+                if (w == 0) swaps++;
+            }
+            // counts are rewritten next pass and out is read by everyone
+            sync.arrive_and_wait();
+        }
+    });
+    if (swaps % 2) items.swap(scratch);
+}
+
 using namespace SmallGraphicsLayer;
 
 void SmallGraphicsLayer::EnableLogger() {
@@ -56,6 +454,9 @@ void SmallGraphicsLayer::EnableLogger() {
 
 std::uint32_t Device::width  = 0;
 std::uint32_t Device::height = 0;
+Math::Affine2D Device::projection_2d;
+RenderQueue Device::queue;
+Device::Retired Device::retired;
 
 void Device::Init(int w, int h) {
     if (!Logger::isEnabled()) Logger::Init();
@@ -64,6 +465,7 @@ void Device::Init(int w, int h) {
 
     width = w;
     height = h;
+    projection_2d = Math::Affine2D::ortho(0.0f, Width(), Height(), 0.0f);
 
     std::string backend = "";
     
@@ -110,11 +512,14 @@ void Device::Init(int w, int h) {
     Logger::Log()->info("Graphics Backend: {}", backend);
 
     sg_setup(&desc);
+    GeometryPool::Init();
 
     pass_action.colors[0].load_action = SG_LOADACTION_CLEAR;
 }
 
 void Device::Clear(Colour clear_col) {
+    // matches GetDefaultProjection(), shared by every Sprite::Update() this frame
+    projection_2d = Math::Affine2D::ortho(0.0f, Width(), Height(), 0.0f);
     pass_action.colors[0].clear_value = clear_col;
 
     sg_pass pass = {};
@@ -125,25 +530,377 @@ void Device::Clear(Colour clear_col) {
 }
 
 void Device::Refresh() {
+    queue.Flush();
     sg_end_pass();
     sg_commit();
+    destroy_retired();
+}
+
+void Device::Retire(sg_buffer buffer)     { if (buffer.id != SG_INVALID_ID) retired.buffers.push_back(buffer); }
+void Device::Retire(sg_image image)       { if (image.id != SG_INVALID_ID) retired.images.push_back(image); }
+void Device::Retire(sg_view view)         { if (view.id != SG_INVALID_ID) retired.views.push_back(view); }
+void Device::Retire(sg_pipeline pipeline) { if (pipeline.id != SG_INVALID_ID) retired.pipelines.push_back(pipeline); }
+void Device::Retire(sg_shader shader)     { if (shader.id != SG_INVALID_ID) retired.shaders.push_back(shader); }
+void Device::Retire(sg_sampler sampler)   { if (sampler.id != SG_INVALID_ID) retired.samplers.push_back(sampler); }
+
+void Device::destroy_retired() {
+    // views before the images they wrap, pipelines before their shaders
+    for (sg_view view : retired.views) sg_destroy_view(view);
+    for (sg_image image : retired.images) sg_destroy_image(image);
+    for (sg_buffer buffer : retired.buffers) sg_destroy_buffer(buffer);
+    for (sg_pipeline pipeline : retired.pipelines) sg_destroy_pipeline(pipeline);
+    for (sg_shader shader : retired.shaders) sg_destroy_shader(shader);
+    for (sg_sampler sampler : retired.samplers) sg_destroy_sampler(sampler);
+    retired = {};
 }
 
 void Device::Shutdown() {
+    queue.Destroy();
+    destroy_retired();
+    GeometryPool::Shutdown();
+    ResourceCache::Clear();
     sg_shutdown();
 }
 
+std::uint64_t RenderQueue::MakeKey(std::uint8_t layer, sg_pipeline pipeline, sg_view texture, float depth) {
+    // floats to unsigned with the same order, the top 24 bits are kept
+    const std::uint32_t u = std::bit_cast<std::uint32_t>(depth);
+    const std::uint32_t d = ((u & 0x80000000u) ? ~u : (u | 0x80000000u)) >> 8;
+    // the low 16 bits of a sokol id are its pool slot, unique among live objects
+    return (static_cast<std::uint64_t>(layer) << 56) |
+           (static_cast<std::uint64_t>(pipeline.id & 0xFFFF) << 40) |
+           (static_cast<std::uint64_t>(texture.id & 0xFFFF) << 24) |
+           d;
+}
+
+void RenderQueue::Submit(std::uint64_t key, sg_pipeline pipeline, const sg_bindings& bindings, int base, int count, int instances) {
+    packets.push_back({key, pipeline, bindings, base, count, instances, static_cast<std::uint32_t>(uniform_blocks.size()), 0});
+    sorted = false;
+}
+
+void RenderQueue::SubmitInstances(std::uint64_t key, sg_pipeline pipeline, const sg_bindings& bindings, int bufferSlot,
+                                  const sg_range& instanceData, int base, int count, int instances) {
+    if (bufferSlot < 0 || bufferSlot >= SG_MAX_VERTEXBUFFER_BINDSLOTS) {
+        Logger::Log()->warn("[RenderQueue] Instance buffer slot {} out of range", bufferSlot);
+        return;
+    }
+    Submit(key, pipeline, bindings, base, count, instances);
+    Packet& p = packets.back();
+    p.instance_slot = bufferSlot;
+    p.instance_offset = static_cast<std::uint32_t>(instance_data.size());
+    const auto* bytes = static_cast<const std::uint8_t*>(instanceData.ptr);
+    instance_data.insert(instance_data.end(), bytes, bytes + instanceData.size);
+    instance_data.resize((instance_data.size() + 3) & ~std::size_t{3});
+}
+
+void RenderQueue::Uniforms(int slot, const sg_range& data) {
+    if (packets.empty()) {
+        Logger::Log()->warn("[RenderQueue] Uniforms without a Submit()");
+        return;
+    }
+    const auto* bytes = static_cast<const std::uint8_t*>(data.ptr);
+    uniform_blocks.push_back({slot, static_cast<std::uint32_t>(uniform_data.size()), static_cast<std::uint32_t>(data.size)});
+    uniform_data.insert(uniform_data.end(), bytes, bytes + data.size);
+    packets.back().uniform_count++;
+}
+
+void RenderQueue::Sort() {
+    if (sorted) return;
+    order.resize(packets.size());
+    for (std::size_t i = 0; i < order.size(); i++) order[i] = static_cast<std::uint32_t>(i);
+    // stable so equal keys replay in submission order
+    std::stable_sort(order.begin(), order.end(), [this](std::uint32_t a, std::uint32_t b) { return packets[a].key < packets[b].key; });
+    sorted = true;
+}
+
+void RenderQueue::Merge(std::span<RenderQueue> lists) {
+    Sort();
+    // each run is one queue's packets in key order, as indices into the merged packets
+    struct Run { std::size_t begin, end; };
+    std::vector<Run> runs = {{0, order.size()}};
+    std::vector<std::uint32_t> runs_order(order.begin(), order.end());
+
+    for (RenderQueue& list : lists) {
+        if (&list == this || list.packets.empty()) continue;
+        list.Sort();
+        const auto packet_base  = static_cast<std::uint32_t>(packets.size());
+        const auto block_base   = static_cast<std::uint32_t>(uniform_blocks.size());
+        const auto uniform_base = static_cast<std::uint32_t>(uniform_data.size());
+        const auto instance_base = static_cast<std::uint32_t>(instance_data.size());
+        for (Packet p : list.packets) {
+            p.first_uniform += block_base;
+            p.instance_offset += instance_base;
+            packets.push_back(p);
+        }
+        for (UniformBlock block : list.uniform_blocks) {
+            block.offset += uniform_base;
+            uniform_blocks.push_back(block);
+        }
+        uniform_data.insert(uniform_data.end(), list.uniform_data.begin(), list.uniform_data.end());
+        // both arenas are padded to 4 bytes, so the appended packets stay aligned
+        instance_data.insert(instance_data.end(), list.instance_data.begin(), list.instance_data.end());
+
+        runs.push_back({runs_order.size(), runs_order.size() + list.order.size()});
+        for (const std::uint32_t i : list.order) runs_order.push_back(packet_base + i);
+        list.Clear();
+    }
+
+    // k-way merge, ties go to the earlier run
+    using Head = std::tuple<std::uint64_t, std::size_t, std::size_t>;  // key, run, position in runs_order
+    std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heads;
+    for (std::size_t r = 0; r < runs.size(); r++) {
+        if (runs[r].begin < runs[r].end) heads.push({packets[runs_order[runs[r].begin]].key, r, runs[r].begin});
+    }
+    order.clear();
+    while (!heads.empty()) {
+        const auto [key, r, at] = heads.top();
+        heads.pop();
+        order.push_back(runs_order[at]);
+        if (at + 1 < runs[r].end) heads.push({packets[runs_order[at + 1]].key, r, at + 1});
+    }
+    sorted = true;
+}
+
+void RenderQueue::Flush() {
+    stats = {};
+    stats.packets = static_cast<std::uint32_t>(packets.size());
+    Sort();
+
+    if (!instance_data.empty()) {
+        const std::size_t size = instance_data.size();
+        // appends from earlier flushes this frame are still in use, so a full buffer is replaced, not reused
+        if (instance_buffer.id == SG_INVALID_ID || sg_query_buffer_will_overflow(instance_buffer, size)) {
+            Device::Retire(instance_buffer);
+            instance_capacity = std::max({instance_capacity * 2, size, std::size_t{64} << 10});
+            sg_buffer_desc desc = {};
+            desc.size = instance_capacity;
+            desc.usage.stream_update = true;
+            desc.usage.vertex_buffer = true;
+            desc.label = "render-queue-instances";
+            instance_buffer = sg_make_buffer(desc);
+        }
+        const sg_range range = {instance_data.data(), size};
+        const int base = sg_append_buffer(instance_buffer, &range);
+        for (Packet& p : packets) {
+            if (p.instance_slot < 0) continue;
+            p.bindings.vertex_buffers[p.instance_slot] = instance_buffer;
+            p.bindings.vertex_buffer_offsets[p.instance_slot] = base + static_cast<int>(p.instance_offset);
+        }
+        stats.instance_bytes = size;
+    }
+
+    std::uint32_t pipeline = SG_INVALID_ID;
+    const sg_bindings* bindings = nullptr;
+    std::array<const UniformBlock*, SG_MAX_UNIFORMBLOCK_BINDSLOTS> applied = {};
+    for (const std::uint32_t index : order) {
+        const Packet& p = packets[index];
+        // applying a pipeline makes sokol expect fresh bindings and uniforms
+        if (p.pipeline.id != pipeline) {
+            sg_apply_pipeline(p.pipeline);
+            pipeline = p.pipeline.id;
+            bindings = nullptr;
+            applied.fill(nullptr);
+            stats.pipelines++;
+        }
+        if (!bindings || std::memcmp(bindings, &p.bindings, sizeof(sg_bindings)) != 0) {
+            sg_apply_bindings(&p.bindings);
+            bindings = &p.bindings;
+            stats.bindings++;
+        }
+        for (std::uint32_t u = 0; u < p.uniform_count; u++) {
+            const UniformBlock& block = uniform_blocks[p.first_uniform + u];
+            const UniformBlock* last = applied[block.slot];
+            if (last && last->size == block.size && std::memcmp(&uniform_data[last->offset], &uniform_data[block.offset], block.size) == 0) continue;
+            sg_apply_uniforms(block.slot, {&uniform_data[block.offset], block.size});
+            applied[block.slot] = &block;
+            stats.uniforms++;
+        }
+        sg_draw(p.base, p.count, p.instances);
+    }
+    Clear();
+}
+
+void RenderQueue::Clear() {
+    packets.clear();
+    uniform_blocks.clear();
+    uniform_data.clear();
+    instance_data.clear();
+    order.clear();
+    sorted = true;
+}
+
+void RenderQueue::Destroy() {
+    Clear();
+    if (instance_buffer.id != SG_INVALID_ID) sg_destroy_buffer(instance_buffer);
+    instance_buffer = {};
+    instance_capacity = 0;
+}
+
+sg_buffer GeometryPool::unit_quad = {};
+sg_buffer GeometryPool::centred_quad = {};
+sg_buffer GeometryPool::fullscreen_triangle = {};
+sg_buffer GeometryPool::quad_indices = {};
+
+void GeometryPool::Init() {
+    const float unit[] = {
+        0.0f, 0.0f,   0.0f, 0.0f,
+        1.0f, 0.0f,   1.0f, 0.0f,
+        1.0f, 1.0f,   1.0f, 1.0f,
+        0.0f, 1.0f,   0.0f, 1.0f
+    };
+    unit_quad = make_immutable_buffer(SG_RANGE(unit), false, "unit-quad");
+
+    const float centred[] = {
+        -0.5f, -0.5f,   0.0f, 0.0f,
+         0.5f, -0.5f,   1.0f, 0.0f,
+         0.5f,  0.5f,   1.0f, 1.0f,
+        -0.5f,  0.5f,   0.0f, 1.0f
+    };
+    centred_quad = make_immutable_buffer(SG_RANGE(centred), false, "centred-quad");
+
+    const float fullscreen[] = { -1.0f, -1.0f,   3.0f, -1.0f,   -1.0f, 3.0f };
+    fullscreen_triangle = make_immutable_buffer(SG_RANGE(fullscreen), false, "fullscreen-triangle");
+
+    std::vector<std::uint16_t> indices(static_cast<std::size_t>(MaxQuads) * 6);
+    for (std::uint32_t q = 0; q < MaxQuads; q++) {
+        const auto base = static_cast<std::uint16_t>(q * 4);
+        std::uint16_t* i = &indices[q * 6];
+        i[0] = base; i[1] = base + 1; i[2] = base + 2;
+        i[3] = base + 2; i[4] = base + 3; i[5] = base;
+    }
+    sg_range range;
+    range.ptr = indices.data();
+    range.size = indices.size() * sizeof(std::uint16_t);
+    quad_indices = make_immutable_buffer(range, true, "quad-indices");
+}
+
+void GeometryPool::Shutdown() {
+    sg_destroy_buffer(unit_quad);
+    sg_destroy_buffer(centred_quad);
+    sg_destroy_buffer(fullscreen_triangle);
+    sg_destroy_buffer(quad_indices);
+    unit_quad = centred_quad = fullscreen_triangle = quad_indices = {};
+}
+
+ResourceCache::Pool<sg_shader> ResourceCache::shaders{};
+ResourceCache::Pool<sg_pipeline> ResourceCache::pipelines{};
+ResourceCache::Pool<sg_sampler> ResourceCache::samplers{};
+
+template <typename T, typename Make>
+T ResourceCache::acquire(Pool<T>& pool, std::string key, Make make) {
+    // the map compares whole keys, so a hit is always the same descriptor
+    if (auto it = pool.entries.find(key); it != pool.entries.end()) {
+        it->second.refs++;
+        return it->second.handle;
+    }
+    T handle = make();
+    pool.keys.emplace(handle.id, key);
+    pool.entries.emplace(std::move(key), typename Pool<T>::Entry{handle, 1});
+    return handle;
+}
+
+template <typename T>
+void ResourceCache::release(Pool<T>& pool, T handle, void (*destroy)(T)) {
+    auto key = pool.keys.find(handle.id);
+    if (key == pool.keys.end()) return;
+    auto it = pool.entries.find(key->second);
+    if (--it->second.refs == 0) {
+        destroy(handle);
+        pool.entries.erase(it);
+        pool.keys.erase(key);
+    }
+}
+
+// Every field sokol reads except labels, keep in step with sokol_gfx.h
+sg_shader ResourceCache::AcquireShader(const sg_shader_desc& desc) {
+    // sources are keyed by content (AttributeProgram keeps its own copy)
+    DescKey key;
+    for (const sg_shader_function* func : {&desc.vertex_func, &desc.fragment_func, &desc.compute_func}) {
+        key.add(func->source, func->bytecode, func->entry, func->d3d11_target, func->d3d11_filepath);
+    }
+    for (const auto& attr : desc.attrs) key.add(attr.base_type, attr.glsl_name, attr.hlsl_sem_name, attr.hlsl_sem_index);
+    for (const auto& ub : desc.uniform_blocks) {
+        key.add(ub.stage, ub.size, ub.hlsl_register_b_n, ub.msl_buffer_n, ub.wgsl_group0_binding_n, ub.layout);
+        for (const auto& u : ub.glsl_uniforms) key.add(u.type, u.array_count, u.glsl_name);
+    }
+    for (const auto& view : desc.views) {
+        const auto& tex = view.texture;
+        key.add(tex.stage, tex.image_type, tex.sample_type, tex.multisampled, tex.hlsl_register_t_n, tex.msl_texture_n,
+                tex.wgsl_group1_binding_n);
+        const auto& sbuf = view.storage_buffer;
+        key.add(sbuf.stage, sbuf.readonly, sbuf.hlsl_register_t_n, sbuf.hlsl_register_u_n, sbuf.msl_buffer_n,
+                sbuf.wgsl_group1_binding_n, sbuf.glsl_binding_n);
+        const auto& simg = view.storage_image;
+        key.add(simg.stage, simg.image_type, simg.access_format, simg.writeonly, simg.hlsl_register_u_n, simg.msl_texture_n,
+                simg.wgsl_group1_binding_n, simg.glsl_binding_n);
+    }
+    for (const auto& smp : desc.samplers) {
+        key.add(smp.stage, smp.sampler_type, smp.hlsl_register_s_n, smp.msl_sampler_n, smp.wgsl_group1_binding_n);
+    }
+    for (const auto& pair : desc.texture_sampler_pairs) key.add(pair.stage, pair.view_slot, pair.sampler_slot, pair.glsl_name);
+    const auto& threads = desc.mtl_threads_per_threadgroup;
+    key.add(threads.x, threads.y, threads.z);
+    return acquire(shaders, key.take(), [&] { return sg_make_shader(&desc); });
+}
+
+sg_pipeline ResourceCache::AcquirePipeline(const sg_pipeline_desc& desc) {
+    DescKey key;
+    key.add(desc.compute, desc.shader.id);
+    for (const auto& buf : desc.layout.buffers) key.add(buf.stride, buf.step_func, buf.step_rate);
+    for (const auto& attr : desc.layout.attrs) key.add(attr.buffer_index, attr.offset, attr.format);
+    const auto& depth = desc.depth;
+    key.add(depth.pixel_format, depth.compare, depth.write_enabled, depth.bias, depth.bias_slope_scale, depth.bias_clamp);
+    const auto& stencil = desc.stencil;
+    key.add(stencil.enabled, stencil.read_mask, stencil.write_mask, stencil.ref);
+    for (const sg_stencil_face_state* face : {&stencil.front, &stencil.back}) {
+        key.add(face->compare, face->fail_op, face->depth_fail_op, face->pass_op);
+    }
+    key.add(desc.color_count);
+    for (const auto& col : desc.colors) {
+        const auto& blend = col.blend;
+        key.add(col.pixel_format, col.write_mask, blend.enabled, blend.src_factor_rgb, blend.dst_factor_rgb, blend.op_rgb,
+                blend.src_factor_alpha, blend.dst_factor_alpha, blend.op_alpha);
+    }
+    key.add(desc.primitive_type, desc.index_type, desc.cull_mode, desc.face_winding, desc.sample_count,
+            desc.blend_color.r, desc.blend_color.g, desc.blend_color.b, desc.blend_color.a, desc.alpha_to_coverage_enabled);
+    return acquire(pipelines, key.take(), [&] { return sg_make_pipeline(&desc); });
+}
+
+sg_sampler ResourceCache::AcquireSampler(const sg_sampler_desc& desc) {
+    DescKey key;
+    key.add(desc.min_filter, desc.mag_filter, desc.mipmap_filter, desc.wrap_u, desc.wrap_v, desc.wrap_w, desc.min_lod,
+            desc.max_lod, desc.border_color, desc.compare, desc.max_anisotropy, desc.gl_sampler, desc.mtl_sampler,
+            desc.d3d11_sampler, desc.wgpu_sampler);
+    return acquire(samplers, key.take(), [&] { return sg_make_sampler(&desc); });
+}
+
+// the last release may come while queued packets still use the object
+void ResourceCache::Release(sg_shader shader)     { release(shaders, shader, Device::Retire); }
+void ResourceCache::Release(sg_pipeline pipeline) { release(pipelines, pipeline, Device::Retire); }
+void ResourceCache::Release(sg_sampler sampler)   { release(samplers, sampler, Device::Retire); }
+
+void ResourceCache::Clear() {
+    // pipelines reference shaders, so they go first
+    for (auto& [key, entry] : pipelines.entries) sg_destroy_pipeline(entry.handle);
+    for (auto& [key, entry] : shaders.entries) sg_destroy_shader(entry.handle);
+    for (auto& [key, entry] : samplers.entries) sg_destroy_sampler(entry.handle);
+    pipelines = {};
+    shaders = {};
+    samplers = {};
+}
+
 AttributeProgram::AttributeProgram(const std::string& frag) {
     if (!frag.empty()) {
         frag_src_storage = frag;
         applied_uniforms = false;
         desc.vertex_func.source = 
             "#version 410\n"
+            "uniform vec4 vs_params[4];\n"
             "layout(location=0) in vec3 position;\n"
             "layout(location=1) in vec4 colour0;\n"
             "out vec2 TexCoord;\n"
             "void main() {\n"
-            "    gl_Position = vec4(position.xyz, 1.0);\n"
+            "    gl_Position = mat4(vs_params[0], vs_params[1], vs_params[2], vs_params[3]) * vec4(position.xyz, 1.0);\n"
             "    TexCoord = vec2(colour0.x, colour0.y);\n"
             "}";
         desc.fragment_func.source = frag_src_storage.c_str();
@@ -156,6 +913,13 @@ AttributeProgram::AttributeProgram(const std::string& frag) {
         desc.uniform_blocks[0].glsl_uniforms[1].glsl_name = "iTime";
         desc.uniform_blocks[0].glsl_uniforms[1].type = SG_UNIFORMTYPE_FLOAT;
 
+        desc.uniform_blocks[VertexUniformSlot].stage = SG_SHADERSTAGE_VERTEX;
+        desc.uniform_blocks[VertexUniformSlot].layout = SG_UNIFORMLAYOUT_STD140;
+        desc.uniform_blocks[VertexUniformSlot].size = sizeof(attributes_params_t);
+        desc.uniform_blocks[VertexUniformSlot].glsl_uniforms[0].glsl_name = "vs_params";
+        desc.uniform_blocks[VertexUniformSlot].glsl_uniforms[0].type = SG_UNIFORMTYPE_FLOAT4;
+        desc.uniform_blocks[VertexUniformSlot].glsl_uniforms[0].array_count = 4;
+
         params.resolution[0] = 0;
         params.resolution[1] = 0;
         params.time = 0;
@@ -169,32 +933,42 @@ void AttributeProgram::ApplyDefaultUniforms(Math::Vec2 resolution, float time) {
     applied_uniforms = true;
 }
 
-AttributeBuilder &AttributeBuilder::Begin(Primitives primitive) {
-    elements = static_cast<int>(primitive);
-
+void AttributeBuilder::select_pipeline(sg_index_type indexType) {
+    // the program is fixed per builder, so only a new index type needs a different pipeline.
+    // ResourceCache shares the compiled program with every other builder using the same source.
+    if (pipeline.id != SG_INVALID_ID && pipeline_index_type == indexType && pipeline_colour_format == colour_format) return;
+    ResourceCache::Release(pipeline);
+    ResourceCache::Release(shader);
+    pipeline_index_type = indexType;
+    pipeline_colour_format = colour_format;
+
+    // UBYTE4N still arrives as a normalised vec4, so the shaders are the same for both formats
+    const sg_vertex_format colour = colour_format == ColourFormat::UNorm8 ? SG_VERTEXFORMAT_UBYTE4N : SG_VERTEXFORMAT_FLOAT4;
+    sg_pipeline_desc pip_desc = {};
+    pip_desc.index_type = indexType;
     if (use_custom_fragment) {
-        shader = sg_make_shader(program.GetDesc());
-        sg_pipeline_desc pip_desc = {};
-        pip_desc.shader = shader;
-        pip_desc.index_type = elements == 4 ? SG_INDEXTYPE_UINT16 : SG_INDEXTYPE_NONE;
+        shader = ResourceCache::AcquireShader(program.GetDesc());
         pip_desc.layout.attrs[0].format = SG_VERTEXFORMAT_FLOAT3;
-        pip_desc.layout.attrs[1].format = SG_VERTEXFORMAT_FLOAT4;
-        pipeline = sg_make_pipeline(&pip_desc);
+        pip_desc.layout.attrs[1].format = colour;
     } else {
-        shader = sg_make_shader(attributes_main_shader_desc(sg_query_backend()));
-
-        sg_pipeline_desc pip_desc = {};
-        pip_desc.shader = shader;
-        pip_desc.index_type = elements == 4 ? SG_INDEXTYPE_UINT16 : SG_INDEXTYPE_NONE;
+        shader = ResourceCache::AcquireShader(*attributes_main_shader_desc(sg_query_backend()));
         pip_desc.layout.attrs[ATTR_attributes_main_position].format = SG_VERTEXFORMAT_FLOAT3;
-        pip_desc.layout.attrs[ATTR_attributes_main_colour0].format = SG_VERTEXFORMAT_FLOAT4;
-        pipeline = sg_make_pipeline(&pip_desc);
+        pip_desc.layout.attrs[ATTR_attributes_main_colour0].format = colour;
     }
+    pip_desc.shader = shader;
+    pipeline = ResourceCache::AcquirePipeline(pip_desc);
+}
+
+AttributeBuilder &AttributeBuilder::Begin(Primitives primitive) {
+    elements = static_cast<int>(primitive);
 
     // 4 + 2 indices
     if (primitive == Primitives::Quad) elements += 2;
     expected_chunks = elements;
     chunks = 0;
+    colour_format = next_colour_format;
+    vertices.clear();
+    indices.clear();
 
     return *this;
 }
@@ -202,60 +976,145 @@ AttributeBuilder &AttributeBuilder::Begin(Primitives primitive) {
 // should personally throw a warn if there are less than expected chunks as well
 AttributeBuilder& AttributeBuilder::Vertex(Position pos, Colour col, bool useNDC) {
     enable_ndc = useNDC;  
-    Math::Vec3 position = enable_ndc ? pos : _Pixels2NDC(pos);
-    std::array<float, 7> chunk = {position.x, position.y, position.z,  col.r, col.g, col.b, col.a};
-    vertices.insert(vertices.end(), chunk.begin(), chunk.end());
+    Math::Vec3 position = (enable_ndc || gpu_transform) ? pos : _Pixels2NDC(pos);
+    const std::size_t start = vertices.size();
+    vertices.resize(start + vertex_words());
+    if (colour_format == ColourFormat::UNorm8) {
+        write_vertices_packed(vertices.data() + start, &position, &col, 0, 1, 1.f, 0.f, 1.f, 0.f);
+    } else {
+        write_vertices(vertices.data() + start, &position, &col, 0, 1, 1.f, 0.f, 1.f, 0.f);
+    }
     chunks++;
     return *this;
 }
 
+AttributeBuilder& AttributeBuilder::Vertices(std::span<const Position> positions, std::span<const Colour> colours, bool useNDC) {
+    if (colours.size() != positions.size() && colours.size() != 1) {
+        Logger::Log()->error("[AttributeBuilder::Vertices] Expected 1 or {} colours, got {}", positions.size(), colours.size());
+        return *this;
+    }
+    enable_ndc = useNDC;
+
+    // same mapping as _Pixels2NDC, folded into a multiply-add
+    float sx = 2.f / framebuf.x, ox = -1.f;
+    float sy = -2.f / framebuf.y, oy = 1.f;
+    if (enable_ndc || gpu_transform) {
+        sx = sy = 1.f;
+        ox = oy = 0.f;
+    }
+
+    const std::size_t start = vertices.size();
+    const std::size_t col_stride = colours.size() == 1 ? 0 : 1;
+    vertices.resize(start + positions.size() * vertex_words());
+    if (colour_format == ColourFormat::UNorm8) {
+        write_vertices_packed(vertices.data() + start, positions.data(), colours.data(), col_stride, positions.size(), sx, ox, sy, oy);
+    } else {
+        write_vertices(vertices.data() + start, positions.data(), colours.data(), col_stride, positions.size(), sx, ox, sy, oy);
+    }
+    chunks += static_cast<int>(positions.size());
+    return *this;
+}
+
 AttributeBuilder& AttributeBuilder::Index(SmallGraphicsLayer::Index index) {
-    std::array<std::uint16_t, 3> chunk = {index.x, index.y, index.z};
+    std::array<std::uint32_t, 3> chunk = {index.x, index.y, index.z};
     indices.insert(indices.end(), chunk.begin(), chunk.end());
     chunks++;
     return *this;
 }
 
 void AttributeBuilder::End() {
-    if (vertices.size() > 0) {
-        sg_buffer_desc vbuf_desc = {};
-        vbuf_desc.size = vertices.size() * sizeof(float);
-        vbuf_desc.data.ptr = vertices.data();
-        vbuf_desc.data.size = vertices.size() * sizeof(float);
-        bindings.vertex_buffers[0] = sg_make_buffer(&vbuf_desc);
+    const std::size_t vertex_count = vertices.size() / vertex_words();
+    draw_count = static_cast<int>(indices.empty() ? vertex_count : indices.size());
+
+    // 16-bit indices while the mesh fits in them, 32-bit beyond so it still draws in one call
+    sg_index_type index_type = SG_INDEXTYPE_NONE;
+    sg_range idata = {};
+    if (!indices.empty() && vertex_count <= 65536) {
+        index_type = SG_INDEXTYPE_UINT16;
+        indices16.resize(indices.size());
+        std::transform(indices.begin(), indices.end(), indices16.begin(), [](std::uint32_t i) { return static_cast<std::uint16_t>(i); });
+        idata.ptr = indices16.data();
+        idata.size = indices16.size() * sizeof(std::uint16_t);
+    } else if (!indices.empty()) {
+        index_type = SG_INDEXTYPE_UINT32;
+        idata.ptr = indices.data();
+        idata.size = indices.size() * sizeof(std::uint32_t);
+    }
+    select_pipeline(index_type);
+
+    sg_range vdata;
+    vdata.ptr = vertices.data();
+    vdata.size = vertices.size() * sizeof(std::uint32_t);
+
+    if (streaming) {
+        if (vdata.size > 0) stream_upload(vbuf, vbuf_capacity, vdata, false, "attribute-vertices");
+        if (idata.size > 0) stream_upload(ibuf, ibuf_capacity, idata, true, "attribute-indices");
+    } else {
+        // a rebuilt mesh replaces the previous buffers rather than leaking them
+        Device::Retire(vbuf);
+        Device::Retire(ibuf);
+        vbuf = {};
+        ibuf = {};
+        vbuf_capacity = ibuf_capacity = 0;
+        if (vdata.size > 0) vbuf = make_immutable_buffer(vdata, false, "attribute-vertices");
+        if (idata.size > 0) ibuf = make_immutable_buffer(idata, true, "attribute-indices");
     }
+    bindings.vertex_buffers[0] = vbuf;
+    bindings.index_buffer = indices.empty() ? sg_buffer{} : ibuf;
+}
 
-    if (indices.size() > 0) {
-        sg_buffer_desc ibuf_desc = {};
-        ibuf_desc.usage.index_buffer = true;
-        ibuf_desc.data.ptr = indices.data();
-        ibuf_desc.size = indices.size() * sizeof(std::uint16_t);
-        bindings.index_buffer = sg_make_buffer(&ibuf_desc);
+// Pixel to NDC as a matrix when the GPU does the mapping, identity otherwise
+static attributes_params_t attribute_vs_params(bool gpuTransform, Math::Vec2 framebuf) {
+    attributes_params_t params;
+    params.mvp = Math::Mat4(1.f);
+    if (gpuTransform) {
+        params.mvp(0, 0) = 2.f / framebuf.x;
+        params.mvp(0, 3) = -1.f;
+        params.mvp(1, 1) = -2.f / framebuf.y;
+        params.mvp(1, 3) = 1.f;
     }
+    return params;
 }
 
 void AttributeBuilder::Draw() const {
     sg_apply_pipeline(pipeline);
     sg_apply_bindings(&bindings);
-    sg_draw(0, elements, 1);
+    const attributes_params_t vs_params = attribute_vs_params(gpu_transform, framebuf);
+    sg_apply_uniforms(use_custom_fragment ? AttributeProgram::VertexUniformSlot : UB_attributes_params, SG_RANGE(vs_params));
+    sg_draw(0, draw_count, 1);
 }
 
+void AttributeBuilder::Submit(RenderQueue& queue, std::uint8_t layer, float depth) const {
+    if (use_custom_fragment) {
+        Logger::Log()->warn("[AttributeBuilder] Submit() with a custom fragment program, use Draw(program) instead");
+        return;
+    }
+    const attributes_params_t vs_params = attribute_vs_params(gpu_transform, framebuf);
+    queue.Submit(RenderQueue::MakeKey(layer, pipeline, {}, depth), pipeline, bindings, 0, draw_count);
+    queue.Uniforms(UB_attributes_params, SG_RANGE(vs_params));
+}
 void AttributeBuilder::Draw(AttributeProgram p) const {
     sg_apply_pipeline(pipeline);
     sg_apply_bindings(&bindings);
+    const attributes_params_t vs_params = attribute_vs_params(gpu_transform, framebuf);
+    sg_apply_uniforms(use_custom_fragment ? AttributeProgram::VertexUniformSlot : UB_attributes_params, SG_RANGE(vs_params));
         if (use_custom_fragment) {
         if (!p.HasAppliedUniforms()) p.ApplyDefaultUniforms();
         auto params = p.GetUniformParams();
         sg_apply_uniforms(0, SG_RANGE(params));
     }
-    sg_draw(0, elements, 1);
+    sg_draw(0, draw_count, 1);
 }
 
 void AttributeBuilder::Destroy() {
-    sg_destroy_shader(shader);
-    sg_destroy_buffer(vbuf);
-    sg_destroy_buffer(ibuf);
-    sg_destroy_pipeline(pipeline);
+    Device::Retire(vbuf);
+    Device::Retire(ibuf);
+    vbuf = ibuf = {};
+    vbuf_capacity = ibuf_capacity = 0;
+    ResourceCache::Release(pipeline);
+    ResourceCache::Release(shader);
+    pipeline = {};
+    shader = {};
 }
 
 Sprite::Sprite(std::tuple<int, int, unsigned char*> data) {
@@ -275,31 +1134,14 @@ Sprite::Sprite(std::tuple<int, int, unsigned char*> data) {
     sg_sampler_desc smp_desc = {};
     smp_desc.min_filter = SG_FILTER_LINEAR;
     smp_desc.mag_filter = SG_FILTER_NEAREST;
-    sg_sampler smp = sg_make_sampler(smp_desc);
-
-    const float vertices[] = {
-        0.0f, 0.0f, 0.0f,   0.0f, 0.0f,
-        1.0f, 0.0f, 0.0f,   1.0f, 0.0f,
-        1.0f, 1.0f, 0.0f,   1.0f, 1.0f,
-        0.0f, 1.0f, 0.0f,   0.0f, 1.0f
-    };
-
-    sg_buffer_desc vbuf_desc = {};
-    vbuf_desc.data = SG_RANGE(vertices);
-    vbuf_desc.usage.vertex_buffer = true;
-    vbuf = sg_make_buffer(vbuf_desc);
+    sg_sampler smp = ResourceCache::AcquireSampler(smp_desc);
 
-    const std::uint16_t indices[] = { 0, 1, 2,  2, 3, 0 };
-    sg_buffer_desc ibuf_desc = {};
-    ibuf_desc.data = SG_RANGE(indices);
-    ibuf_desc.usage.index_buffer = true;
-    ibuf = sg_make_buffer(ibuf_desc);
-
-    sg_shader shd = sg_make_shader(sprite_main_shader_desc(sg_query_backend()));
+    shader = ResourceCache::AcquireShader(*sprite_main_shader_desc(sg_query_backend()));
 
     sg_pipeline_desc pip_desc = {};
-    pip_desc.shader = shd;
-    pip_desc.layout.attrs[ATTR_sprite_main_pos].format = SG_VERTEXFORMAT_FLOAT3;
+    pip_desc.shader = shader;
+    // the shared unit quad is 2D, z comes in as 0
+    pip_desc.layout.attrs[ATTR_sprite_main_pos].format = SG_VERTEXFORMAT_FLOAT2;
     pip_desc.layout.attrs[ATTR_sprite_main_texcoord0].format = SG_VERTEXFORMAT_FLOAT2;
     pip_desc.sample_count = 1;
     pip_desc.color_count = 1;
@@ -313,20 +1155,19 @@ Sprite::Sprite(std::tuple<int, int, unsigned char*> data) {
     pip_desc.colors->blend.dst_factor_rgb = SG_BLENDFACTOR_ONE_MINUS_SRC_ALPHA;
     pip_desc.depth.pixel_format = SG_PIXELFORMAT_DEPTH_STENCIL;
     pip_desc.index_type = SG_INDEXTYPE_UINT16;
-    pipeline = sg_make_pipeline(pip_desc);
+    pipeline = ResourceCache::AcquirePipeline(pip_desc);
 
-    bindings.vertex_buffers[0] = vbuf;
-    bindings.index_buffer = ibuf;
+    bindings.vertex_buffers[0] = GeometryPool::UnitQuad();
+    bindings.index_buffer = GeometryPool::QuadIndices();
     sg_view_desc view_desc = {};
     view_desc.texture.image = image;
     bindings.views[VIEW_sprite_tex] = sg_make_view(&view_desc);
     bindings.samplers[SMP_sprite_smp] = smp;
 }
 
-void Sprite::Update(Math::Vec2 position, Math::Vec2 origin, Math::Vec2 scale) {
-    params.mvp = GetDefaultProjection();
-    params.mvp *= Math::Mat4::translate({ position.x - origin.x, position.y - origin.y, 0.0f });
-    params.mvp *= Math::Mat4::scale({ size.x * scale.x, size.y * scale.y, 1.0f });
+void Sprite::Update(Math::Vec2 position, Math::Vec2 origin, Math::Vec2 scale, const Math::Affine2D& projection) {
+    const Math::Affine2D model = Math::Affine2D::translateScale(position - origin, {size.x * scale.x, size.y * scale.y});
+    params.mvp = (projection * model).toMat4();
 }
 
 void Sprite::Draw() const {
@@ -335,23 +1176,192 @@ void Sprite::Draw() const {
     sg_apply_uniforms(UB_sprite_params, SG_RANGE(params));
     sg_draw(0, 6, 1);
 }
+void Sprite::Submit(RenderQueue& queue, std::uint8_t layer, float depth) const {
+    queue.Submit(RenderQueue::MakeKey(layer, pipeline, bindings.views[VIEW_sprite_tex], depth), pipeline, bindings, 0, 6);
+    queue.Uniforms(UB_sprite_params, SG_RANGE(params));
+}
 
 void Sprite::Destroy() {
-    sg_destroy_buffer(vbuf);
-    sg_destroy_buffer(ibuf);
-    sg_destroy_buffer(bindings.vertex_buffers[0]);
-    sg_destroy_buffer(bindings.index_buffer);
-    sg_destroy_view(bindings.views[VIEW_sprite_tex]);
-    sg_destroy_sampler(bindings.samplers[SMP_sprite_smp]);
-    sg_destroy_image(image);
-    sg_destroy_pipeline(pipeline);
+    Device::Retire(bindings.views[VIEW_sprite_tex]);
+    ResourceCache::Release(bindings.samplers[SMP_sprite_smp]);
+    bindings.samplers[SMP_sprite_smp] = {};
+    Device::Retire(image);
+    ResourceCache::Release(pipeline);
+    ResourceCache::Release(shader);
+    pipeline = {};
+    shader = {};
 }
 
-InstancedSprite::InstancedSprite(std::tuple<int, int, unsigned char*> data, Math::Vec2 tileSize, std::uint16_t maxInstances) {
+// World-space {x0, y0, x1, y1} that lands inside the NDC square under mvp, mvp must be invertible
+static Math::Vec4 view_bounds(const Math::Affine2D& mvp) {
+    const Math::Affine2D inv = mvp.inverse();
+    const Math::Vec2 corners[4] = {
+        inv.multiplyPoint({-1, -1}), inv.multiplyPoint({1, -1}),
+        inv.multiplyPoint({1, 1}),   inv.multiplyPoint({-1, 1})
+    };
+    Math::Vec4 b = {corners[0].x, corners[0].y, corners[0].x, corners[0].y};
+    for (const auto& c : corners) {
+        b.x = std::min(b.x, c.x); b.z = std::max(b.z, c.x);
+        b.y = std::min(b.y, c.y); b.w = std::max(b.w, c.y);
+    }
+    return b;
+}
+
+SpatialGrid::CellRange SpatialGrid::cells_for(const Math::Vec4& rect) const {
+    // clamped so far-off or unbounded rects still convert to int
+    const auto cell = [this](float v) { return static_cast<int>(std::clamp(std::floor(v * inv_cell), -1e9f, 1e9f)); };
+    return {cell(rect.x), cell(rect.y), cell(rect.x + rect.z), cell(rect.y + rect.w)};
+}
+static std::uint64_t grid_cell_key(int x, int y) {
+    return (static_cast<std::uint64_t>(static_cast<std::uint32_t>(x)) << 32) | static_cast<std::uint32_t>(y);
+}
+void SpatialGrid::link(std::uint32_t id, const CellRange& range) {
+    for (int y = range.y0; y <= range.y1; y++) {
+        for (int x = range.x0; x <= range.x1; x++) cells[grid_cell_key(x, y)].push_back(id);
+    }
+}
+void SpatialGrid::unlink(std::uint32_t id, const CellRange& range) {
+    for (int y = range.y0; y <= range.y1; y++) {
+        for (int x = range.x0; x <= range.x1; x++) {
+            auto it = cells.find(grid_cell_key(x, y));
+            if (it == cells.end()) continue;
+            auto& ids = it->second;
+            auto pos = std::find(ids.begin(), ids.end(), id);
+            if (pos != ids.end()) {
+                *pos = ids.back();
+                ids.pop_back();
+            }
+            // empty cells stay allocated, moving objects tend to come back
+        }
+    }
+}
+void SpatialGrid::Insert(std::uint32_t id, Math::Vec4 rect) {
+    if (id >= items.size()) {
+        items.resize(id + 1);
+        stamps.resize(id + 1, 0);
+    }
+    Item& item = items[id];
+    if (item.live) {
+        Move(id, rect);
+        return;
+    }
+    item.rect = rect;
+    item.cells = cells_for(rect);
+    item.live = true;
+    link(id, item.cells);
+}
+void SpatialGrid::Move(std::uint32_t id, Math::Vec4 rect) {
+    if (!Contains(id)) {
+        Insert(id, rect);
+        return;
+    }
+    Item& item = items[id];
+    item.rect = rect;
+    const CellRange range = cells_for(rect);
+    if (range.x0 == item.cells.x0 && range.y0 == item.cells.y0 && range.x1 == item.cells.x1 && range.y1 == item.cells.y1) return;
+    unlink(id, item.cells);
+    item.cells = range;
+    link(id, range);
+}
+void SpatialGrid::Remove(std::uint32_t id) {
+    if (!Contains(id)) return;
+    unlink(id, items[id].cells);
+    items[id].live = false;
+}
+void SpatialGrid::Clear() {
+    cells.clear();
+    items.clear();
+    stamps.clear();
+    query_stamp = 0;
+}
+void SpatialGrid::Query(Math::Vec4 rect, std::vector<std::uint32_t>& out) const {
+    if (++query_stamp == 0) {
+        std::fill(stamps.begin(), stamps.end(), 0);
+        query_stamp = 1;
+    }
+    const auto visit = [&](const std::vector<std::uint32_t>& ids) {
+        for (const std::uint32_t id : ids) {
+            if (stamps[id] == query_stamp) continue;
+            stamps[id] = query_stamp;
+            const Math::Vec4& r = items[id].rect;
+            if (r.x < rect.x + rect.z && r.x + r.z > rect.x && r.y < rect.y + rect.w && r.y + r.w > rect.y) out.push_back(id);
+        }
+    };
+
+    const CellRange range = cells_for(rect);
+    const std::int64_t covered = (std::int64_t{range.x1} - range.x0 + 1) * (std::int64_t{range.y1} - range.y0 + 1);
+    // a rect wider than the populated world is cheaper to answer from the occupied cells
+    if (covered > static_cast<std::int64_t>(cells.size())) {
+        for (const auto& [key, ids] : cells) {
+            const int x = static_cast<int>(static_cast<std::uint32_t>(key >> 32));
+            const int y = static_cast<int>(static_cast<std::uint32_t>(key));
+            if (x >= range.x0 && x <= range.x1 && y >= range.y0 && y <= range.y1) visit(ids);
+        }
+        return;
+    }
+    for (int y = range.y0; y <= range.y1; y++) {
+        for (int x = range.x0; x <= range.x1; x++) {
+            auto it = cells.find(grid_cell_key(x, y));
+            if (it != cells.end()) visit(it->second);
+        }
+    }
+}
+
+// Shader, sampler and pipeline descriptors shared by InstancedSprite and TileMap, so ResourceCache
+// hands both the same objects and their instance layouts can't drift apart
+static const sg_shader_desc& instance_shader_desc(InstanceFormat format) {
+    return format == InstanceFormat::Compact ? *instance_compact_shader_desc() : *instance_main_shader_desc(sg_query_backend());
+}
+
+static sg_sampler_desc instance_sampler_desc() {
+    sg_sampler_desc smp_desc = {};
+    smp_desc.min_filter = SG_FILTER_LINEAR;
+    smp_desc.mag_filter = SG_FILTER_NEAREST;
+    return smp_desc;
+}
+
+static sg_pipeline_desc make_instance_pipeline_desc(sg_shader shader, InstanceFormat format) {
+    sg_pipeline_desc pip_desc = {};
+    pip_desc.shader = shader;
+    pip_desc.index_type = SG_INDEXTYPE_UINT16;
+
+    pip_desc.layout.buffers[0].stride    = 4 * sizeof(float);
+    pip_desc.layout.buffers[1].step_func = SG_VERTEXSTEP_PER_INSTANCE;
+
+    pip_desc.layout.attrs[ATTR_instance_main_aPos].format       = SG_VERTEXFORMAT_FLOAT2;
+    pip_desc.layout.attrs[ATTR_instance_main_aPos].buffer_index = 0;
+    pip_desc.layout.attrs[ATTR_instance_main_aUV].format        = SG_VERTEXFORMAT_FLOAT2;
+    pip_desc.layout.attrs[ATTR_instance_main_aUV].buffer_index  = 0;
+
+    if (format == InstanceFormat::Compact) {
+        pip_desc.layout.attrs[ATTR_instance_compact_aOffset].format         = SG_VERTEXFORMAT_SHORT2;
+        pip_desc.layout.attrs[ATTR_instance_compact_aOffset].buffer_index   = 1;
+        pip_desc.layout.attrs[ATTR_instance_compact_aUVOrigin].format       = SG_VERTEXFORMAT_USHORT2;
+        pip_desc.layout.attrs[ATTR_instance_compact_aUVOrigin].buffer_index = 1;
+        pip_desc.layout.attrs[ATTR_instance_compact_aSize].format           = SG_VERTEXFORMAT_USHORT2;
+        pip_desc.layout.attrs[ATTR_instance_compact_aSize].buffer_index     = 1;
+    } else {
+        pip_desc.layout.attrs[ATTR_instance_main_aOffset].format           = SG_VERTEXFORMAT_FLOAT2;
+        pip_desc.layout.attrs[ATTR_instance_main_aOffset].buffer_index     = 1;
+        pip_desc.layout.attrs[ATTR_instance_main_aUVOffset].format         = SG_VERTEXFORMAT_FLOAT2;
+        pip_desc.layout.attrs[ATTR_instance_main_aUVOffset].buffer_index   = 1;
+        pip_desc.layout.attrs[ATTR_instance_main_aWorldScale].format       = SG_VERTEXFORMAT_FLOAT2;
+        pip_desc.layout.attrs[ATTR_instance_main_aWorldScale].buffer_index = 1;
+        pip_desc.layout.attrs[ATTR_instance_main_aUVScale].format          = SG_VERTEXFORMAT_FLOAT2;
+        pip_desc.layout.attrs[ATTR_instance_main_aUVScale].buffer_index    = 1;
+    }
+
+    set_alpha_blend(pip_desc);
+    pip_desc.label = "pipeline";
+    return pip_desc;
+}
+
+InstancedSprite::InstancedSprite(std::tuple<int, int, unsigned char*> data, Math::Vec2 tileSize, std::uint32_t maxInstances,
+                                 InstanceStream stream, InstanceFormat format) : stream(stream), format(format) {
     tile_size = tileSize;
     vs_params.mvp = GetDefaultProjection();
 
-    sg_shader shader = sg_make_shader(instance_main_shader_desc(sg_query_backend()));
+    shader = ResourceCache::AcquireShader(instance_shader_desc(format));
     int w = std::get<0>(data), h = std::get<1>(data);
     unsigned char* pixels = std::get<2>(data);
     sg_image_desc image_desc = {};
@@ -359,18 +1369,15 @@ InstancedSprite::InstancedSprite(std::tuple<int, int, unsigned char*> data, Math
     image_desc.height = h;
     image_desc.data.mip_levels[0].ptr = pixels;
     image_desc.data.mip_levels[0].size = static_cast<std::size_t>(w * h * 4);
-    sg_image image = sg_make_image(image_desc);
+    image = sg_make_image(image_desc);
 
     this->w = w;
     this->h = h;
 
-    sg_sampler_desc smp_desc = {};
-    smp_desc.min_filter = SG_FILTER_LINEAR;
-    smp_desc.mag_filter = SG_FILTER_NEAREST;
-    sg_sampler smp = sg_make_sampler(smp_desc);
+    sg_sampler smp = ResourceCache::AcquireSampler(instance_sampler_desc());
 
-    bindings.vertex_buffers[0] = make_unit_vbuf();
-    bindings.index_buffer = make_ibuf();
+    bindings.vertex_buffers[0] = GeometryPool::UnitQuad();
+    bindings.index_buffer = GeometryPool::QuadIndices();
 
     sg_view_desc view_desc = {};
     view_desc.texture.image = image;
@@ -378,61 +1385,852 @@ InstancedSprite::InstancedSprite(std::tuple<int, int, unsigned char*> data, Math
     bindings.views[VIEW_instance_tex] = sg_make_view(&view_desc);
     bindings.samplers[SMP_instance_smp] = smp;
 
+    grow_chunks(std::max<std::size_t>(maxInstances, 1));
+
+    pipeline = ResourceCache::AcquirePipeline(make_instance_pipeline_desc(shader, format));
+}
+
+InstanceHandle InstancedSprite::PushData(const Math::Vec2 offset, const Math::Vec2 tile_index, Math::Vec2 tile_size) {
+    std::uint32_t slot;
+    if (!free_slots.empty()) {
+        slot = free_slots.back();
+        free_slots.pop_back();
+    } else {
+        slot = static_cast<std::uint32_t>(sparse.size());
+        sparse.push_back(UINT32_MAX);
+        generations.push_back(0);
+    }
+    sparse[slot] = static_cast<std::uint32_t>(instances.size());
+    dense_slots.push_back(slot);
+    sort_keys.push_back(0.f);
+    instances.push_back(create_instance_data(offset, tile_index, tile_size));
+    mark_dirty(instances.size() - 1, 1);
+    if (grid) grid->Insert(slot, instance_rect(instances.back()));
+    return {slot, generations[slot]};
+}
+
+void InstancedSprite::Update(InstanceHandle handle, const Math::Vec2 offset, const Math::Vec2 tile_index, Math::Vec2 tile_size) {
+    if (!Valid(handle)) {
+        Logger::Log()->warn("[InstancedSprite] Update with a stale instance handle");
+        return;
+    }
+    const std::uint32_t index = sparse[handle.slot];
+    instances[index] = create_instance_data(offset, tile_index, tile_size);
+    mark_dirty(index, 1);
+    if (grid) grid->Move(handle.slot, instance_rect(instances[index]));
+}
+
+void InstancedSprite::Remove(InstanceHandle handle) {
+    if (!Valid(handle)) {
+        Logger::Log()->warn("[InstancedSprite] Remove with a stale instance handle");
+        return;
+    }
+    const std::uint32_t index = sparse[handle.slot];
+    const std::uint32_t last = static_cast<std::uint32_t>(instances.size() - 1);
+    if (index != last) {
+        instances[index] = instances[last];
+        dense_slots[index] = dense_slots[last];
+        sort_keys[index] = sort_keys[last];
+        sparse[dense_slots[index]] = index;
+        mark_dirty(index, 1);
+    }
+    instances.pop_back();
+    dense_slots.pop_back();
+    sort_keys.pop_back();
+
+    sparse[handle.slot] = UINT32_MAX;
+    generations[handle.slot]++;
+    free_slots.push_back(handle.slot);
+    if (grid) grid->Remove(handle.slot);
+    dirty = true;
+}
+
+void InstancedSprite::Clear() {
+    for (const std::uint32_t slot : dense_slots) {
+        sparse[slot] = UINT32_MAX;
+        generations[slot]++;
+        free_slots.push_back(slot);
+    }
+    instances.clear();
+    dense_slots.clear();
+    sort_keys.clear();
+    if (grid) grid->Clear();
+    dirty = true;
+}
+void InstancedSprite::EnableSpatialIndex(float cellSize) {
+    grid.emplace(cellSize);
+    for (std::size_t i = 0; i < instances.size(); i++) grid->Insert(dense_slots[i], instance_rect(instances[i]));
+}
+void InstancedSprite::QueryRect(Math::Vec4 rect, std::vector<InstanceHandle>& out) const {
+    if (grid) {
+        query_ids.clear();
+        grid->Query(rect, query_ids);
+        for (const std::uint32_t slot : query_ids) out.push_back({slot, generations[slot]});
+        return;
+    }
+    for (std::size_t i = 0; i < instances.size(); i++) {
+        const Math::Vec4 r = instance_rect(instances[i]);
+        if (r.x < rect.x + rect.z && r.x + r.z > rect.x && r.y < rect.y + rect.w && r.y + r.w > rect.y) {
+            out.push_back({dense_slots[i], generations[dense_slots[i]]});
+        }
+    }
+}
+
+void InstancedSprite::mark_dirty(const std::size_t first, const std::size_t count) {
+    dirty = true;
+    const std::size_t last = first + count;
+    for (std::size_t c = first / max_chunk_instances; c < chunks.size() && c * max_chunk_instances < last; c++) {
+        for (auto& end : chunks[c].slot_dirty_end) end = std::max(end, last - c * max_chunk_instances);
+    }
+}
+
+void InstancedSprite::resize_chunk(InstanceChunk& chunk, const std::size_t capacity) {
+    if (chunk.buffer.id != SG_INVALID_ID) {
+        Logger::Log()->info("[InstancedSprite] Growing instance buffer from {} to {} instances", chunk.capacity, capacity);
+        Device::Retire(chunk.buffer);
+    }
     sg_buffer_desc inst_desc = {};
-    inst_desc.size = sizeof(InstanceData) * maxInstances;
+    inst_desc.size = instance_stride() * capacity;
     inst_desc.usage.stream_update = true;
     inst_desc.usage.vertex_buffer = true;
     inst_desc.label = "instance-buffer";
-    bindings.vertex_buffers[1] = sg_make_buffer(inst_desc);
+    chunk.buffer = sg_make_buffer(inst_desc);
+    chunk.capacity = capacity;
+    // a new buffer starts out empty, the first write to each slot must cover every instance
+    chunk.slot_dirty_end.fill(SIZE_MAX);
+    chunk.active_slot = 0;
+}
 
-    sg_pipeline_desc pip_desc = {};
-    pip_desc.shader = shader;
-    pip_desc.index_type = SG_INDEXTYPE_UINT16;
+void InstancedSprite::grow_chunks(const std::size_t count) {
+    for (std::size_t c = 0; c * max_chunk_instances < count; c++) {
+        const std::size_t want = std::min(count - c * max_chunk_instances, max_chunk_instances);
+        if (c == chunks.size()) {
+            chunks.emplace_back();
+            resize_chunk(chunks.back(), want);
+        } else if (chunks[c].capacity < want) {
+            resize_chunk(chunks[c], std::min(std::max(chunks[c].capacity * 2, want), max_chunk_instances));
+        }
+    }
+}
 
-    pip_desc.layout.buffers[0].stride    = 4 * sizeof(float);
-    pip_desc.layout.buffers[1].step_func = SG_VERTEXSTEP_PER_INSTANCE;
+bool InstancedSprite::pack_compact(const InstanceData* src, const std::size_t count, CompactInstanceData* out) const {
+    bool clamped = false;
+    const auto quantise = [&clamped](float v, float lo, float hi) {
+        const float r = std::round(v);
+        clamped |= r < lo || r > hi;
+        return std::clamp(r, lo, hi);
+    };
+    for (std::size_t i = 0; i < count; i++) {
+        const InstanceData& in = src[i];
+        for (int k = 0; k < 2; k++) {
+            const float atlas = static_cast<float>(k == 0 ? w : h);
+            out[i].offset[k]   = static_cast<std::int16_t>(quantise(k == 0 ? in.offset.x : in.offset.y, INT16_MIN, INT16_MAX));
+            out[i].uvOrigin[k] = static_cast<std::uint16_t>(quantise((k == 0 ? in.uvOffset.x : in.uvOffset.y) * atlas, 0, UINT16_MAX));
+            out[i].size[k]     = static_cast<std::uint16_t>(quantise(k == 0 ? in.worldScale.x : in.worldScale.y, 0, UINT16_MAX));
+        }
+    }
+    return clamped;
+}
 
-    pip_desc.layout.attrs[ATTR_instance_main_aPos].format       = SG_VERTEXFORMAT_FLOAT2;
-    pip_desc.layout.attrs[ATTR_instance_main_aPos].buffer_index = 0;
-    pip_desc.layout.attrs[ATTR_instance_main_aUV].format        = SG_VERTEXFORMAT_FLOAT2;
-    pip_desc.layout.attrs[ATTR_instance_main_aUV].buffer_index  = 0;
+sg_range InstancedSprite::instance_range(const InstanceData* src, const std::size_t count) {
+    if (format != InstanceFormat::Compact) return {src, count * sizeof(InstanceData)};
 
-    pip_desc.layout.attrs[ATTR_instance_main_aOffset].format           = SG_VERTEXFORMAT_FLOAT2;
-    pip_desc.layout.attrs[ATTR_instance_main_aOffset].buffer_index     = 1;
-    pip_desc.layout.attrs[ATTR_instance_main_aUVOffset].format         = SG_VERTEXFORMAT_FLOAT2;
-    pip_desc.layout.attrs[ATTR_instance_main_aUVOffset].buffer_index   = 1;
-    pip_desc.layout.attrs[ATTR_instance_main_aWorldScale].format       = SG_VERTEXFORMAT_FLOAT2;
-    pip_desc.layout.attrs[ATTR_instance_main_aWorldScale].buffer_index = 1;
-    pip_desc.layout.attrs[ATTR_instance_main_aUVScale].format          = SG_VERTEXFORMAT_FLOAT2;
-    pip_desc.layout.attrs[ATTR_instance_main_aUVScale].buffer_index    = 1;
+    packed.resize(count);
+    if (pack_compact(src, count, packed.data()) && !warned_range) {
+        Logger::Log()->warn("[InstancedSprite] Instance outside the compact format's range, clamping (use InstanceFormat::Float)");
+        warned_range = true;
+    }
+    return {packed.data(), count * sizeof(CompactInstanceData)};
+}
+void InstancedSprite::SetCulling(bool enabled) {
+    if (culling == enabled) return;
+    culling = enabled;
+    // whatever is on the GPU was filtered for the other mode
+    for (auto& chunk : chunks) chunk.slot_dirty_end.fill(SIZE_MAX);
+    dirty = true;
+}
+std::size_t InstancedSprite::cull(const Math::Affine2D& mvp) {
+    // sized to every instance and never shrunk, so culling doesn't touch the tail each frame
+    if (visible.size() < instances.size()) visible.resize(instances.size());
+    if (std::fabs(mvp.determinant()) < 1e-12f) {
+        std::copy(instances.begin(), instances.end(), visible.begin());
+        return instances.size();
+    }
+    const Math::Vec4 view = view_bounds(mvp);
+    const float x0 = view.x, y0 = view.y, x1 = view.z, y1 = view.w;
+
+    if (grid) {
+        query_ids.clear();
+        grid->Query({x0, y0, x1 - x0, y1 - y0}, query_ids);
+        // back to dense order so overlapping instances keep their draw order
+        for (std::uint32_t& id : query_ids) id = sparse[id];
+        std::sort(query_ids.begin(), query_ids.end());
+        for (std::size_t i = 0; i < query_ids.size(); i++) visible[i] = instances[query_ids[i]];
+        return query_ids.size();
+    }
 
-    set_alpha_blend(pip_desc);
-    pip_desc.label = "pipeline";
-    pipeline = sg_make_pipeline(pip_desc);
+    // branchless compaction, every instance is written and the cursor only advances for survivors
+    std::size_t n = 0;
+    for (const InstanceData& inst : instances) {
+        const float ax = inst.offset.x + std::min(inst.worldScale.x, 0.f);
+        const float bx = inst.offset.x + std::max(inst.worldScale.x, 0.f);
+        const float ay = inst.offset.y + std::min(inst.worldScale.y, 0.f);
+        const float by = inst.offset.y + std::max(inst.worldScale.y, 0.f);
+        visible[n] = inst;
+        n += static_cast<std::size_t>((ax < x1) & (bx > x0) & (ay < y1) & (by > y0));
+    }
+    return n;
+}
+void InstancedSprite::SetSort(InstanceSort mode, unsigned threads) {
+    sort_mode = mode;
+    sort_threads = std::max(threads, 1u);
 }
+void InstancedSprite::SetSortKey(InstanceHandle handle, float key) {
+    if (!Valid(handle)) {
+        Logger::Log()->warn("[InstancedSprite] SetSortKey with a stale instance handle");
+        return;
+    }
+    sort_keys[sparse[handle.slot]] = key;
+}
+void InstancedSprite::sort_instances() {
+    const auto start = std::chrono::steady_clock::now();
+    const std::size_t n = instances.size();
+
+    // floats to unsigned keys with the same order
+    const auto float_key = [](float f) {
+        const std::uint32_t u = std::bit_cast<std::uint32_t>(f);
+        return (u & 0x80000000u) ? ~u : (u | 0x80000000u);
+    };
+    sort_items.resize(n);
+    std::size_t descents = 0;
+    for (std::size_t i = 0; i < n; i++) {
+        const float key = sort_mode == InstanceSort::Y ? instances[i].offset.y + std::max(instances[i].worldScale.y, 0.f) : sort_keys[i];
+        sort_items[i] = (static_cast<std::uint64_t>(float_key(key)) << 32) | i;
+        descents += i > 0 && sort_items[i] < sort_items[i - 1];
+    }
+    if (descents == 0) {
+        sort_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return;
+    }
 
+    // last frame's order is usually almost right, insertion sort costs n plus the moves it makes
+    bool sorted = false;
+    if (descents <= n / 64 + 8) {
+        std::size_t budget = 2 * n;
+        sorted = true;
+        for (std::size_t i = 1; i < n && sorted; i++) {
+            const std::uint64_t item = sort_items[i];
+            std::size_t j = i;
+            for (; j > 0 && sort_items[j - 1] > item; j--) sort_items[j] = sort_items[j - 1];
+            sort_items[j] = item;
+            const std::size_t moved = i - j;
+            if (moved > budget) sorted = false;
+            else budget -= moved;
+        }
+    }
+    // the pairs are still a permutation if insertion sort gave up, radix sort doesn't care
+    if (!sorted) radix_sort_pairs(sort_items, sort_scratch, sort_threads);
+
+    // apply the order to every dense array and repoint the handles, only moved instances are copied
+    sorted_instances.clear();
+    sorted_slots.clear();
+    sorted_keys.clear();
+    sorted_at.clear();
+    for (std::size_t i = 0; i < n; i++) {
+        const std::size_t from = static_cast<std::size_t>(sort_items[i] & 0xFFFFFFFFu);
+        if (from == i) continue;
+        sorted_instances.push_back(instances[from]);
+        sorted_slots.push_back(dense_slots[from]);
+        sorted_keys.push_back(sort_keys[from]);
+        sorted_at.push_back(static_cast<std::uint32_t>(i));
+    }
+    for (std::size_t k = 0; k < sorted_at.size(); k++) {
+        const std::size_t i = sorted_at[k];
+        instances[i] = sorted_instances[k];
+        dense_slots[i] = sorted_slots[k];
+        sort_keys[i] = sorted_keys[k];
+        sparse[dense_slots[i]] = static_cast<std::uint32_t>(i);
+    }
+    if (!sorted_at.empty()) mark_dirty(sorted_at.front(), sorted_at.back() - sorted_at.front() + 1);
+    sort_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
 void InstancedSprite::Update(Math::Mat4 projection, Math::Mat4 view) {
-    if (instances.empty()) return;
-    sg_range range;
-    range.ptr = instances.data();
-    range.size = instances.size() * sizeof(InstanceData);
-    sg_update_buffer(bindings.vertex_buffers[1], &range);
-    dirty = false;
-    
     vs_params.mvp = projection * view;
+    uploaded_bytes = 0;
+    if (sort_mode != InstanceSort::None) sort_instances();
+
+    const InstanceData* src = instances.data();
+    std::size_t total = instances.size();
+    if (culling) {
+        // the visible set follows the view as well as edits
+        if (stream == InstanceStream::Update && !dirty && std::memcmp(&culled_mvp, &vs_params.mvp, sizeof(Math::Mat4)) == 0) return;
+        culled_mvp = vs_params.mvp;
+        total = cull(Math::Affine2D::fromMat4(vs_params.mvp));
+        src = visible.data();
+        // compaction moves instances around, the dirty prefixes no longer apply
+        for (auto& chunk : chunks) chunk.slot_dirty_end.fill(SIZE_MAX);
+        dirty = true;
+    }
+    visible_count = total;
+
+    if (stream == InstanceStream::Append) {
+        // appended data only lives for the frame, so every call uploads
+        grow_chunks(total);
+        for (std::size_t c = 0; c < chunks.size(); c++) {
+            InstanceChunk& chunk = chunks[c];
+            const std::size_t begin = c * max_chunk_instances;
+            const std::size_t count = total > begin ? std::min(total - begin, max_chunk_instances) : 0;
+            chunk.draw_count = 0;
+            if (count == 0) continue;
+
+            const sg_range range = instance_range(src + begin, count);
+            // each append lands after the previous one this frame, Draw() reads from its offset
+            if (sg_query_buffer_will_overflow(chunk.buffer, range.size)) {
+                if (chunk.capacity == max_chunk_instances) {
+                    Logger::Log()->warn("[InstancedSprite] Instance buffer full this frame, skipping {} instances", count);
+                    continue;
+                }
+                // earlier draws this frame have already been issued from the old buffer
+                resize_chunk(chunk, std::min(std::max(chunk.capacity * 2, count), max_chunk_instances));
+            }
+            chunk.offset = sg_append_buffer(chunk.buffer, &range);
+            chunk.draw_count = static_cast<int>(count);
+            uploaded_bytes += range.size;
+        }
+        dirty = false;
+        return;
+    }
+
+    if (!dirty) return;
+    dirty = false;
+    grow_chunks(total);
+
+    for (std::size_t c = 0; c < chunks.size(); c++) {
+        InstanceChunk& chunk = chunks[c];
+        const std::size_t begin = c * max_chunk_instances;
+        const std::size_t count = total > begin ? std::min(total - begin, max_chunk_instances) : 0;
+        chunk.draw_count = static_cast<int>(count);
+
+        const int next_slot = (chunk.active_slot + 1) % SG_NUM_INFLIGHT_FRAMES;
+        std::size_t end = std::min(chunk.slot_dirty_end[next_slot], count);
+        // D3D11 maps with WRITE_DISCARD, anything past the written prefix would be lost
+        if (sg_query_backend() == SG_BACKEND_D3D11) end = count;
+        // shrinking alone leaves the active slot valid
+        if (end == 0) continue;
+
+        const sg_range range = instance_range(src + begin, end);
+        sg_update_buffer(chunk.buffer, &range);
+        chunk.active_slot = next_slot;
+        chunk.slot_dirty_end[next_slot] = 0;
+        uploaded_bytes += range.size;
+    }
 }
 
 void InstancedSprite::Draw() const {
-    if (instances.empty()) return;
+    bool applied = false;
+    sg_bindings bind = bindings;
+    for (const InstanceChunk& chunk : chunks) {
+        if (chunk.draw_count == 0) continue;
+        bind.vertex_buffers[1] = chunk.buffer;
+        bind.vertex_buffer_offsets[1] = stream == InstanceStream::Append ? chunk.offset : 0;
+        if (!applied) {
+            sg_apply_pipeline(pipeline);
+            sg_apply_bindings(&bind);
+            if (format == InstanceFormat::Compact) {
+                instance_compact_params_t params = {vs_params.mvp, {1.f / static_cast<float>(w), 1.f / static_cast<float>(h), 0.f, 0.f}};
+                sg_apply_uniforms(UB_instance_compact_params, SG_RANGE(params));
+            } else {
+                sg_apply_uniforms(UB_instance_params, SG_RANGE(vs_params));
+            }
+            applied = true;
+        } else {
+            sg_apply_bindings(&bind);
+        }
+        sg_draw(0, 6, chunk.draw_count);
+    }
+}
+
+void InstancedSprite::Submit(RenderQueue& queue, std::uint8_t layer, float depth) const {
+    const std::uint64_t key = RenderQueue::MakeKey(layer, pipeline, bindings.views[VIEW_instance_tex], depth);
+    instance_compact_params_t compact_params = {vs_params.mvp, {1.f / static_cast<float>(w), 1.f / static_cast<float>(h), 0.f, 0.f}};
+    sg_bindings bind = bindings;
+    for (const InstanceChunk& chunk : chunks) {
+        if (chunk.draw_count == 0) continue;
+        bind.vertex_buffers[1] = chunk.buffer;
+        bind.vertex_buffer_offsets[1] = stream == InstanceStream::Append ? chunk.offset : 0;
+        queue.Submit(key, pipeline, bind, 0, 6, chunk.draw_count);
+        if (format == InstanceFormat::Compact) queue.Uniforms(UB_instance_compact_params, SG_RANGE(compact_params));
+        else queue.Uniforms(UB_instance_params, SG_RANGE(vs_params));
+    }
+}
+
+void InstancedSprite::Record(RenderQueue& queue, std::span<const InstanceData> data, const Math::Mat4& mvp,
+                             std::uint8_t layer, float depth) const {
+    if (data.empty()) return;
+    const std::uint64_t key = RenderQueue::MakeKey(layer, pipeline, bindings.views[VIEW_instance_tex], depth);
+    const int count = static_cast<int>(data.size());
+    if (format == InstanceFormat::Compact) {
+        // one scratch buffer per recording thread
+        thread_local std::vector<CompactInstanceData> scratch;
+        scratch.resize(data.size());
+        static std::atomic<bool> warned = false;
+        if (pack_compact(data.data(), data.size(), scratch.data()) && !warned.exchange(true)) {
+            Logger::Log()->warn("[InstancedSprite] Recorded instance outside the compact format's range, clamping");
+        }
+        queue.SubmitInstances(key, pipeline, bindings, 1, {scratch.data(), scratch.size() * sizeof(CompactInstanceData)}, 0, 6, count);
+        const instance_compact_params_t params = {mvp, {1.f / static_cast<float>(w), 1.f / static_cast<float>(h), 0.f, 0.f}};
+        queue.Uniforms(UB_instance_compact_params, SG_RANGE(params));
+    } else {
+        queue.SubmitInstances(key, pipeline, bindings, 1, {data.data(), data.size() * sizeof(InstanceData)}, 0, 6, count);
+        const instance_params_t params = {mvp};
+        queue.Uniforms(UB_instance_params, SG_RANGE(params));
+    }
+}
+
+void InstancedSprite::Destroy() {
+    Clear();
+    for (auto& chunk : chunks) Device::Retire(chunk.buffer);
+    chunks.clear();
+    Device::Retire(bindings.views[VIEW_instance_tex]);
+    Device::Retire(image);
+    bindings.views[VIEW_instance_tex] = {};
+    image = {};
+    ResourceCache::Release(bindings.samplers[SMP_instance_smp]);
+    bindings.samplers[SMP_instance_smp] = {};
+    ResourceCache::Release(pipeline);
+    ResourceCache::Release(shader);
+    pipeline = {};
+    shader = {};
+}
+
+TileMap::TileMap(std::tuple<int, int, unsigned char*> data, Math::Vec2 tileSize, int width, int height)
+    : width(width), height(height), tile_size(tileSize) {
+    vs_params.mvp = GetDefaultProjection();
+    chunks_x = (width + ChunkSize - 1) / ChunkSize;
+    chunks_y = (height + ChunkSize - 1) / ChunkSize;
+    tiles.resize(static_cast<std::size_t>(width) * height);
+    chunks.resize(static_cast<std::size_t>(chunks_x) * chunks_y);
+
+    image = make_image(data);
+    atlas_size = {static_cast<float>(std::get<0>(data)), static_cast<float>(std::get<1>(data))};
+    sg_view_desc view_desc = {};
+    view_desc.texture.image = image;
+    bindings.views[VIEW_instance_tex] = sg_make_view(&view_desc);
+
+    bindings.samplers[SMP_instance_smp] = ResourceCache::AcquireSampler(instance_sampler_desc());
+    bindings.vertex_buffers[0] = GeometryPool::UnitQuad();
+    bindings.index_buffer = GeometryPool::QuadIndices();
+
+    shader = ResourceCache::AcquireShader(instance_shader_desc(InstanceFormat::Float));
+    pipeline = ResourceCache::AcquirePipeline(make_instance_pipeline_desc(shader, InstanceFormat::Float));
+}
+
+void TileMap::set_tile(int x, int y, const Tile& tile) {
+    if (x < 0 || y < 0 || x >= width || y >= height) {
+        Logger::Log()->warn("[TileMap] Tile ({}, {}) is outside the {}x{} map", x, y, width, height);
+        return;
+    }
+    tiles[static_cast<std::size_t>(y) * width + x] = tile;
+    chunks[static_cast<std::size_t>(y / ChunkSize) * chunks_x + x / ChunkSize].dirty = true;
+}
+
+void TileMap::SetTile(int x, int y, Math::Vec2 tileIndex) {
+    SetTile(x, y, tileIndex, {x * tile_size.x, y * tile_size.y});
+}
+
+void TileMap::SetTile(int x, int y, Math::Vec2 tileIndex, Math::Vec2 offset) {
+    set_tile(x, y, {offset, tileIndex, true});
+}
+
+void TileMap::ClearTile(int x, int y) {
+    set_tile(x, y, {});
+}
+
+void TileMap::rebuild(std::size_t chunk_index) {
+    Chunk& chunk = chunks[chunk_index];
+    chunk.dirty = false;
+    Device::Retire(chunk.buffer);
+    chunk.buffer = {};
+
+    const int cx = static_cast<int>(chunk_index % chunks_x) * ChunkSize;
+    const int cy = static_cast<int>(chunk_index / chunks_x) * ChunkSize;
+    const Math::Vec2 uv_scale = {tile_size.x / atlas_size.x, tile_size.y / atlas_size.y};
+
+    scratch.clear();
+    Math::Vec4 bounds = {INFINITY, INFINITY, -INFINITY, -INFINITY};
+    for (int y = cy; y < std::min(cy + ChunkSize, height); y++) {
+        for (int x = cx; x < std::min(cx + ChunkSize, width); x++) {
+            const Tile& tile = tiles[static_cast<std::size_t>(y) * width + x];
+            if (!tile.used) continue;
+            scratch.push_back({tile.offset, get_tile_uv(tile.index, tile_size, atlas_size), tile_size, uv_scale});
+            bounds.x = std::min(bounds.x, tile.offset.x);
+            bounds.y = std::min(bounds.y, tile.offset.y);
+            bounds.z = std::max(bounds.z, tile.offset.x + tile_size.x);
+            bounds.w = std::max(bounds.w, tile.offset.y + tile_size.y);
+        }
+    }
+    chunk.count = static_cast<int>(scratch.size());
+    chunk.bounds = bounds;
+    if (chunk.count == 0) return;
+    const sg_range range = {scratch.data(), scratch.size() * sizeof(InstancedSprite::InstanceData)};
+    chunk.buffer = make_immutable_buffer(range, false, "tilemap-chunk");
+}
+
+void TileMap::Update(const Math::Mat4 &projection, const Math::Mat4 &view) {
+    vs_params.mvp = projection * view;
+
+    rebuilt = 0;
+    for (std::size_t c = 0; c < chunks.size(); c++) {
+        if (!chunks[c].dirty) continue;
+        rebuild(c);
+        rebuilt++;
+    }
+
+    visible.clear();
+    const Math::Affine2D mvp = Math::Affine2D::fromMat4(vs_params.mvp);
+    const bool cull = std::fabs(mvp.determinant()) >= 1e-12f;
+    const Math::Vec4 v = cull ? view_bounds(mvp) : Math::Vec4{};
+    for (std::size_t c = 0; c < chunks.size(); c++) {
+        const Chunk& chunk = chunks[c];
+        if (chunk.count == 0) continue;
+        if (cull && (chunk.bounds.x >= v.z || chunk.bounds.z <= v.x || chunk.bounds.y >= v.w || chunk.bounds.w <= v.y)) continue;
+        visible.push_back(static_cast<std::uint32_t>(c));
+    }
+}
+
+void TileMap::Draw() const {
+    if (visible.empty()) return;
+    sg_apply_pipeline(pipeline);
+    sg_bindings bind = bindings;
+    bool applied = false;
+    for (const std::uint32_t c : visible) {
+        bind.vertex_buffers[1] = chunks[c].buffer;
+        sg_apply_bindings(&bind);
+        if (!applied) {
+            sg_apply_uniforms(UB_instance_params, SG_RANGE(vs_params));
+            applied = true;
+        }
+        sg_draw(0, 6, chunks[c].count);
+    }
+}
+
+void TileMap::Submit(RenderQueue& queue, std::uint8_t layer, float depth) const {
+    const std::uint64_t key = RenderQueue::MakeKey(layer, pipeline, bindings.views[VIEW_instance_tex], depth);
+    sg_bindings bind = bindings;
+    for (const std::uint32_t c : visible) {
+        bind.vertex_buffers[1] = chunks[c].buffer;
+        queue.Submit(key, pipeline, bind, 0, 6, chunks[c].count);
+        queue.Uniforms(UB_instance_params, SG_RANGE(vs_params));
+    }
+}
+
+void TileMap::Destroy() {
+    for (auto& chunk : chunks) {
+        Device::Retire(chunk.buffer);
+        chunk = {};
+    }
+    visible.clear();
+    Device::Retire(bindings.views[VIEW_instance_tex]);
+    Device::Retire(image);
+    ResourceCache::Release(bindings.samplers[SMP_instance_smp]);
+    bindings.samplers[SMP_instance_smp] = {};
+    ResourceCache::Release(pipeline);
+    ResourceCache::Release(shader);
+    pipeline = {};
+    shader = {};
+}
+
+IndexedTileMap::IndexedTileMap(std::tuple<int, int, unsigned char*> data, Math::Vec2 tileSize, int width, int height)
+    : width(width), height(height), tile_size(tileSize) {
+    cells.assign(static_cast<std::size_t>(width) * height * 2, empty_tile);
+
+    atlas = make_image(data);
+    atlas_size = {static_cast<float>(std::get<0>(data)), static_cast<float>(std::get<1>(data))};
+
+    // sokol can't update part of an image, edits are gathered and sent once per frame by Update()
+    sg_image_desc index_desc = {};
+    index_desc.width = width;
+    index_desc.height = height;
+    index_desc.pixel_format = SG_PIXELFORMAT_RG8UI;
+    index_desc.usage.dynamic_update = true;
+    index_desc.label = "tilemap-index";
+    index = sg_make_image(&index_desc);
+
+    sg_view_desc view_desc = {};
+    view_desc.texture.image = atlas;
+    bindings.views[VIEW_tilemap_atlas] = sg_make_view(&view_desc);
+    view_desc.texture.image = index;
+    bindings.views[VIEW_tilemap_index] = sg_make_view(&view_desc);
+
+    sg_sampler_desc smp_desc = {};
+    smp_desc.min_filter = SG_FILTER_LINEAR;
+    smp_desc.mag_filter = SG_FILTER_NEAREST;
+    bindings.samplers[SMP_tilemap_atlas] = ResourceCache::AcquireSampler(smp_desc);
+    smp_desc.min_filter = SG_FILTER_NEAREST;
+    bindings.samplers[SMP_tilemap_index] = ResourceCache::AcquireSampler(smp_desc);
+    bindings.vertex_buffers[0] = GeometryPool::FullscreenTriangle();
+
+    shader = ResourceCache::AcquireShader(*tilemap_shader_desc());
+
+    sg_pipeline_desc pip_desc = {};
+    pip_desc.shader = shader;
+    pip_desc.layout.attrs[ATTR_tilemap_pos].format = SG_VERTEXFORMAT_FLOAT2;
+    set_alpha_blend(pip_desc);
+    pip_desc.label = "tilemap-pipeline";
+    pipeline = ResourceCache::AcquirePipeline(pip_desc);
+}
+
+void IndexedTileMap::SetTile(int x, int y, Math::Vec2 tileIndex) {
+    if (x < 0 || y < 0 || x >= width || y >= height) {
+        Logger::Log()->warn("[IndexedTileMap] Tile ({}, {}) is outside the {}x{} map", x, y, width, height);
+        return;
+    }
+    if (tileIndex.x < 0 || tileIndex.y < 0 || tileIndex.x >= empty_tile || tileIndex.y >= empty_tile) {
+        Logger::Log()->warn("[IndexedTileMap] Atlas tile ({}, {}) is out of range", tileIndex.x, tileIndex.y);
+        return;
+    }
+    std::uint8_t* cell = &cells[(static_cast<std::size_t>(y) * width + x) * 2];
+    cell[0] = static_cast<std::uint8_t>(tileIndex.x);
+    cell[1] = static_cast<std::uint8_t>(tileIndex.y);
+    dirty = true;
+}
+
+void IndexedTileMap::ClearTile(int x, int y) {
+    if (x < 0 || y < 0 || x >= width || y >= height) return;
+    std::uint8_t* cell = &cells[(static_cast<std::size_t>(y) * width + x) * 2];
+    cell[0] = cell[1] = empty_tile;
+    dirty = true;
+}
+
+void IndexedTileMap::Update(const Math::Mat4 &projection, const Math::Mat4 &view) {
+    if (dirty) {
+        sg_image_data img_data = {};
+        img_data.mip_levels[0] = {cells.data(), cells.size()};
+        sg_update_image(index, &img_data);
+        dirty = false;
+    }
+
+    const Math::Affine2D mvp = Math::Affine2D::fromMat4(projection * view);
+    visible = std::fabs(mvp.determinant()) >= 1e-12f;
+    if (!visible) return;
+    const Math::Affine2D inv = mvp.inverse();
+    const float vs[8] = {inv.a, inv.b, inv.c, inv.d, inv.tx, inv.ty, 0, 0};
+    const float fs[8] = {tile_size.x, tile_size.y, static_cast<float>(width), static_cast<float>(height),
+                         atlas_size.x, atlas_size.y, position.x, position.y};
+    std::memcpy(vs_params, vs, sizeof(vs_params));
+    std::memcpy(fs_params, fs, sizeof(fs_params));
+}
+
+void IndexedTileMap::Draw() const {
+    if (!visible) return;
     sg_apply_pipeline(pipeline);
     sg_apply_bindings(&bindings);
-    sg_apply_uniforms(UB_instance_params, SG_RANGE(vs_params));
-    sg_draw(0, 6, static_cast<int>(instances.size()));
+    sg_apply_uniforms(UB_tilemap_vs, SG_RANGE(vs_params));
+    sg_apply_uniforms(UB_tilemap_fs, SG_RANGE(fs_params));
+    sg_draw(0, 3, 1);
 }
 
-void InstancedSprite::Destroy() {
-    instances.clear();
-    sg_destroy_pipeline(pipeline);
+void IndexedTileMap::Submit(RenderQueue& queue, std::uint8_t layer, float depth) const {
+    if (!visible) return;
+    queue.Submit(RenderQueue::MakeKey(layer, pipeline, bindings.views[VIEW_tilemap_atlas], depth), pipeline, bindings, 0, 3);
+    queue.Uniforms(UB_tilemap_vs, SG_RANGE(vs_params));
+    queue.Uniforms(UB_tilemap_fs, SG_RANGE(fs_params));
 }
 
+void IndexedTileMap::Destroy() {
+    Device::Retire(bindings.views[VIEW_tilemap_atlas]);
+    Device::Retire(bindings.views[VIEW_tilemap_index]);
+    Device::Retire(atlas);
+    Device::Retire(index);
+    ResourceCache::Release(bindings.samplers[SMP_tilemap_atlas]);
+    bindings.samplers[SMP_tilemap_atlas] = {};
+    ResourceCache::Release(bindings.samplers[SMP_tilemap_index]);
+    bindings.samplers[SMP_tilemap_index] = {};
+    ResourceCache::Release(pipeline);
+    ResourceCache::Release(shader);
+    pipeline = {};
+    shader = {};
+}
+
+BatchedSprite::BatchedSprite(std::uint32_t maxSprites, BatchMode mode) : mode(mode) {
+    batch_quads = std::clamp<std::uint32_t>(maxSprites, 1, GeometryPool::MaxQuads);
+    vbuf_size = static_cast<std::size_t>(std::max<std::uint32_t>(maxSprites, 1)) * 4 * sizeof(Vertex);
+    vertices.reserve(static_cast<std::size_t>(batch_quads) * 4);
+    params.mvp = GetDefaultProjection();
+
+    bindings.index_buffer = GeometryPool::QuadIndices();
+
+    sg_buffer_desc vbuf_desc = {};
+    vbuf_desc.size = vbuf_size;
+    vbuf_desc.usage.vertex_buffer = true;
+    vbuf_desc.usage.stream_update = true;
+    vbuf_desc.label = "batch-vertices";
+    bindings.vertex_buffers[0] = sg_make_buffer(&vbuf_desc);
+
+    sg_sampler_desc smp_desc = {};
+    smp_desc.min_filter = SG_FILTER_LINEAR;
+    smp_desc.mag_filter = SG_FILTER_NEAREST;
+    bindings.samplers[SMP_batch_smp] = ResourceCache::AcquireSampler(smp_desc);
+
+    shader = ResourceCache::AcquireShader(*batch_shader_desc());
+
+    sg_pipeline_desc pip_desc = {};
+    pip_desc.shader = shader;
+    pip_desc.index_type = SG_INDEXTYPE_UINT16;
+    pip_desc.layout.attrs[ATTR_batch_pos].format       = SG_VERTEXFORMAT_FLOAT2;
+    pip_desc.layout.attrs[ATTR_batch_texcoord0].format = SG_VERTEXFORMAT_FLOAT2;
+    pip_desc.layout.attrs[ATTR_batch_colour0].format   = SG_VERTEXFORMAT_UBYTE4N;
+    set_alpha_blend(pip_desc);
+    pip_desc.label = "batch-pipeline";
+    pipeline = ResourceCache::AcquirePipeline(pip_desc);
+}
+
+std::uint16_t BatchedSprite::AddTexture(std::tuple<int, int, unsigned char*> data) {
+    BatchTexture tex;
+    tex.image = make_image(data);
+    sg_view_desc view_desc = {};
+    view_desc.texture.image = tex.image;
+    tex.view = sg_make_view(&view_desc);
+    tex.size = {static_cast<float>(std::get<0>(data)), static_cast<float>(std::get<1>(data))};
+    textures.push_back(tex);
+    return static_cast<std::uint16_t>(textures.size() - 1);
+}
+
+void BatchedSprite::Begin(const Math::Mat4 &projection, const Math::Mat4 &view) {
+    params.mvp = projection * view;
+    vertices.clear();
+    pending.clear();
+    keys.clear();
+    current_texture = -1;
+    current_layer = 0;
+    stats = {};
+}
+
+void BatchedSprite::Draw(std::uint16_t texture, Math::Vec2 position, Math::Vec2 origin, Math::Vec2 scale, Colour tint) {
+    const Math::Vec2 size = textures[texture].size;
+    Draw(texture, {0, 0, size.x, size.y}, position, origin, scale, tint);
+}
+
+void BatchedSprite::Draw(std::uint16_t texture, Math::Vec4 region, Math::Vec2 position, Math::Vec2 origin, Math::Vec2 scale, Colour tint) {
+    // same placement as Sprite::Update, the origin is not scaled
+    const float x0 = position.x - origin.x;
+    const float y0 = position.y - origin.y;
+    const float x1 = x0 + region.z * scale.x;
+    const float y1 = y0 + region.w * scale.y;
+
+    const Math::Vec2 size = textures[texture].size;
+    const float u0 = region.x / size.x;
+    const float v0 = region.y / size.y;
+    const float u1 = (region.x + region.z) / size.x;
+    const float v1 = (region.y + region.w) / size.y;
+
+    const std::uint32_t rgba = pack_colour(tint);
+    const Vertex quad[4] = {
+        {x0, y0, u0, v0, rgba},
+        {x1, y0, u1, v0, rgba},
+        {x1, y1, u1, v1, rgba},
+        {x0, y1, u0, v1, rgba}
+    };
+    stats.sprites++;
+
+    if (mode == BatchMode::Sorted) {
+        pending.insert(pending.end(), quad, quad + 4);
+        keys.push_back((static_cast<std::uint32_t>(current_layer) << 16) | texture);
+        return;
+    }
+    emit(texture, quad);
+}
+
+void BatchedSprite::End() {
+    if (mode == BatchMode::Sorted && !keys.empty()) {
+        const auto start = std::chrono::steady_clock::now();
+        radix_sort_indices(keys, order, scratch);
+        stats.sort_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        for (const std::uint32_t i : order) {
+            emit(static_cast<std::uint16_t>(keys[i] & 0xFFFF), &pending[static_cast<std::size_t>(i) * 4]);
+        }
+        pending.clear();
+        keys.clear();
+    }
+    flush(FlushReason::End);
+    current_texture = -1;
+}
+
+void BatchedSprite::End(RenderQueue& queue, std::uint8_t layer, float depth) {
+    // no texture in the key, textures switch between flushes and must not reorder them
+    target = &queue;
+    target_key = RenderQueue::MakeKey(layer, pipeline, {}, depth);
+    End();
+    target = nullptr;
+}
+
+void BatchedSprite::emit(std::uint16_t texture, const Vertex* quad) {
+    if (current_texture != texture) {
+        flush(FlushReason::Texture);
+        current_texture = texture;
+    } else if (vertices.size() >= static_cast<std::size_t>(batch_quads) * 4) {
+        flush(FlushReason::Full);
+    }
+    vertices.insert(vertices.end(), quad, quad + 4);
+}
+
+void BatchedSprite::flush(FlushReason reason) {
+    if (vertices.empty()) return;
 
+    sg_range range;
+    range.ptr = vertices.data();
+    range.size = vertices.size() * sizeof(Vertex);
+
+    // appends are per frame, so grow rather than drop sprites once the stream is full
+    if (sg_query_buffer_will_overflow(bindings.vertex_buffers[0], range.size)) {
+        vbuf_size = std::max(vbuf_size * 2, range.size);
+        Logger::Log()->warn("[BatchedSprite] Vertex stream full, growing to {} bytes", vbuf_size);
+        Device::Retire(bindings.vertex_buffers[0]);
+        sg_buffer_desc vbuf_desc = {};
+        vbuf_desc.size = vbuf_size;
+        vbuf_desc.usage.vertex_buffer = true;
+        vbuf_desc.usage.stream_update = true;
+        vbuf_desc.label = "batch-vertices";
+        bindings.vertex_buffers[0] = sg_make_buffer(&vbuf_desc);
+    }
+    bindings.vertex_buffer_offsets[0] = sg_append_buffer(bindings.vertex_buffers[0], &range);
+    bindings.views[VIEW_batch_tex] = textures[current_texture].view;
+
+    const auto quads = static_cast<std::uint32_t>(vertices.size() / 4);
+    if (target) {
+        target->Submit(target_key, pipeline, bindings, 0, static_cast<int>(quads * 6));
+        target->Uniforms(UB_batch_params, SG_RANGE(params));
+    } else {
+        sg_apply_pipeline(pipeline);
+        sg_apply_bindings(&bindings);
+        sg_apply_uniforms(UB_batch_params, SG_RANGE(params));
+        sg_draw(0, static_cast<int>(quads * 6), 1);
+    }
+
+    stats.flushes++;
+    stats.upload_bytes += range.size;
+    stats.largest_batch = std::max(stats.largest_batch, quads);
+    if (reason == FlushReason::Texture) stats.texture_flushes++;
+    if (reason == FlushReason::Full) stats.full_flushes++;
+
+    vertices.clear();
+}
+
+void BatchedSprite::Destroy() {
+    for (auto& tex : textures) {
+        Device::Retire(tex.view);
+        Device::Retire(tex.image);
+    }
+    textures.clear();
+    vertices.clear();
+    pending.clear();
+    keys.clear();
+    Device::Retire(bindings.vertex_buffers[0]);
+    ResourceCache::Release(bindings.samplers[SMP_batch_smp]);
+    bindings.samplers[SMP_batch_smp] = {};
+    ResourceCache::Release(pipeline);
+    ResourceCache::Release(shader);
+    pipeline = {};
+    shader = {};
+}
@@ -0,0 +1,60 @@
+// The scalar paths of Math.hpp, renamed so they link next to the SIMD build in math_simd.cpp
+#define SGL_MATH_SCALAR 1
+#define SmallGraphicsLayer SmallGraphicsLayerScalar
+#include "SGL/Math.hpp"
+#undef SmallGraphicsLayer
+
+#include "math_reference.hpp"
+
+#include <cstring>
+#include <span>
+
+using namespace SmallGraphicsLayerScalar::Math;
+
+static Mat4 load_mat4(const float* m) {
+    Mat4 r;
+    std::memcpy(r.m, m, sizeof(r.m));
+    return r;
+}
+
+static Affine2D load_affine(const float* t) {
+    return {t[0], t[1], t[2], t[3], t[4], t[5]};
+}
+
+namespace Reference {
+void Mat4Multiply(const float* a, const float* b, float* out) {
+    const Mat4 r = load_mat4(a) * load_mat4(b);
+    std::memcpy(out, r.m, sizeof(r.m));
+}
+
+void Mat4MultiplyPoint(const float* m, const float* v, float* out) {
+    const Vec3 r = load_mat4(m).multiplyPoint({v[0], v[1], v[2]});
+    out[0] = r.x; out[1] = r.y; out[2] = r.z;
+}
+
+void Mat4MultiplyVector(const float* m, const float* v, float* out) {
+    const Vec3 r = load_mat4(m).multiplyVector({v[0], v[1], v[2]});
+    out[0] = r.x; out[1] = r.y; out[2] = r.z;
+}
+
+void Affine2DInverse(const float* t, float* out) {
+    const Affine2D r = load_affine(t).inverse();
+    const float f[6] = {r.a, r.b, r.c, r.d, r.tx, r.ty};
+    std::memcpy(out, f, sizeof(f));
+}
+
+void TransformAffine2D(const float* xy, std::size_t count, const float* t, float* out) {
+    SmallGraphicsLayerScalar::Math::TransformAffine2D(std::span(reinterpret_cast<const Vec2*>(xy), count),
+                                                      std::span(reinterpret_cast<Vec2*>(out), count), load_affine(t));
+}
+
+void TransformAffine2D(const float* xs, const float* ys, std::size_t count, const float* t, float* outX, float* outY) {
+    SmallGraphicsLayerScalar::Math::TransformAffine2D(std::span(xs, count), std::span(ys, count),
+                                                      std::span(outX, count), std::span(outY, count), load_affine(t));
+}
+
+void TransformPoints(const float* xy, std::size_t count, const float* m, float* out) {
+    SmallGraphicsLayerScalar::Math::TransformPoints(std::span(reinterpret_cast<const Vec2*>(xy), count),
+                                                    std::span(reinterpret_cast<Vec2*>(out), count), load_mat4(m));
+}
+}  // namespace Reference
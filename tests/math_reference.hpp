@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstddef>
+
+// Scalar builds of the Math kernels, compiled in math_reference.cpp with SGL_MATH_SCALAR.
+// Everything crosses as plain floats so the two builds never share a Math type.
+namespace Reference {
+void Mat4Multiply(const float* a, const float* b, float* out);          // 16, 16 -> 16
+void Mat4MultiplyPoint(const float* m, const float* v, float* out);     // 16, 3 -> 3
+void Mat4MultiplyVector(const float* m, const float* v, float* out);    // 16, 3 -> 3
+void Affine2DInverse(const float* t, float* out);                        // 6 -> 6
+void TransformAffine2D(const float* xy, std::size_t count, const float* t, float* out);
+void TransformAffine2D(const float* xs, const float* ys, std::size_t count, const float* t, float* outX, float* outY);
+void TransformPoints(const float* xy, std::size_t count, const float* m, float* out);
+}
@@ -0,0 +1,122 @@
+// Checks the SSE/NEON Math paths against the scalar build, bit for bit
+#include "SGL/Math.hpp"
+#include "math_reference.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <span>
+#include <vector>
+
+using namespace SmallGraphicsLayer::Math;
+
+static int failures = 0;
+
+static void check(const char* what, const void* got, const void* want, std::size_t bytes) {
+    if (std::memcmp(got, want, bytes) != 0) {
+        std::printf("FAIL %s\n", what);
+        failures++;
+    }
+}
+
+static std::mt19937 rng(1234);
+
+static float random_float() {
+    return std::uniform_real_distribution<float>(-1000.f, 1000.f)(rng);
+}
+
+static Mat4 random_mat4() {
+    Mat4 m;
+    for (float& f : m.m) f = random_float();
+    return m;
+}
+
+static Affine2D random_affine() {
+    return {random_float(), random_float(), random_float(), random_float(), random_float(), random_float()};
+}
+
+static void test_mat4() {
+    for (int i = 0; i < 1000; i++) {
+        const Mat4 a = random_mat4(), b = random_mat4();
+        const Vec3 v = {random_float(), random_float(), random_float()};
+
+        const Mat4 product = a * b;
+        float want[16];
+        Reference::Mat4Multiply(a.m, b.m, want);
+        check("Mat4 * Mat4", product.m, want, sizeof(want));
+
+        Mat4 accumulated = a;
+        accumulated *= b;
+        check("Mat4 *= Mat4", accumulated.m, want, sizeof(want));
+
+        const float in[3] = {v.x, v.y, v.z};
+        const Vec3 point = a.multiplyPoint(v);
+        const Vec3 vector = a.multiplyVector(v);
+        float want_point[3], want_vector[3];
+        Reference::Mat4MultiplyPoint(a.m, in, want_point);
+        Reference::Mat4MultiplyVector(a.m, in, want_vector);
+        const float got_point[3] = {point.x, point.y, point.z};
+        const float got_vector[3] = {vector.x, vector.y, vector.z};
+        check("Mat4::multiplyPoint", got_point, want_point, sizeof(want_point));
+        check("Mat4::multiplyVector", got_vector, want_vector, sizeof(want_vector));
+    }
+}
+
+static void test_affine_inverse() {
+    for (int i = 0; i < 1000; i++) {
+        const Affine2D t = random_affine();
+        const Affine2D inv = t.inverse();
+        const float in[6] = {t.a, t.b, t.c, t.d, t.tx, t.ty};
+        const float got[6] = {inv.a, inv.b, inv.c, inv.d, inv.tx, inv.ty};
+        float want[6];
+        Reference::Affine2DInverse(in, want);
+        check("Affine2D::inverse", got, want, sizeof(want));
+    }
+}
+
+// counts around the 4-wide SIMD step, plus one large enough to split across workers
+static void test_transforms() {
+    for (const std::size_t count : {std::size_t{0}, std::size_t{1}, std::size_t{3}, std::size_t{4}, std::size_t{5},
+                                    std::size_t{7}, std::size_t{8}, std::size_t{13}, std::size_t{1023}, std::size_t{70001}}) {
+        const Affine2D t = random_affine();
+        const float tf[6] = {t.a, t.b, t.c, t.d, t.tx, t.ty};
+        const Mat4 m = random_mat4();
+
+        std::vector<Vec2> points(count);
+        std::vector<float> xs(count), ys(count);
+        for (std::size_t i = 0; i < count; i++) {
+            points[i] = {random_float(), random_float()};
+            xs[i] = points[i].x;
+            ys[i] = points[i].y;
+        }
+        const float* flat = reinterpret_cast<const float*>(points.data());
+
+        std::vector<Vec2> got(count);
+        std::vector<float> want(count * 2);
+        Reference::TransformAffine2D(flat, count, tf, want.data());
+        TransformAffine2D(std::span<const Vec2>(points), std::span<Vec2>(got), t);
+        check("TransformAffine2D AoS", got.data(), want.data(), want.size() * sizeof(float));
+        TransformAffine2D(std::span<const Vec2>(points), std::span<Vec2>(got), t, 4);
+        check("TransformAffine2D AoS threaded", got.data(), want.data(), want.size() * sizeof(float));
+
+        std::vector<float> got_x(count), got_y(count), want_x(count), want_y(count);
+        Reference::TransformAffine2D(xs.data(), ys.data(), count, tf, want_x.data(), want_y.data());
+        TransformAffine2D(xs, ys, got_x, got_y, t);
+        check("TransformAffine2D SoA x", got_x.data(), want_x.data(), count * sizeof(float));
+        check("TransformAffine2D SoA y", got_y.data(), want_y.data(), count * sizeof(float));
+
+        Reference::TransformPoints(flat, count, m.m, want.data());
+        TransformPoints(std::span<const Vec2>(points), std::span<Vec2>(got), m);
+        check("TransformPoints", got.data(), want.data(), want.size() * sizeof(float));
+        TransformPoints(std::span<const Vec2>(points), std::span<Vec2>(got), m, 4);
+        check("TransformPoints threaded", got.data(), want.data(), want.size() * sizeof(float));
+    }
+}
+
+int main() {
+    test_mat4();
+    test_affine_inverse();
+    test_transforms();
+    if (failures == 0) std::printf("All Math checks passed\n");
+    return failures == 0 ? 0 : 1;
+}